@@ -3,6 +3,29 @@
 
 #include <iostream>
 #include <algorithm>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <type_traits>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <new>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
 
 using namespace std;
 
@@ -39,13 +62,237 @@ public:
 
 
 
+/*
+ *  Wer keine Aggregate über die Unterbäume braucht,
+ *  verwendet NoAgg (Voreinstellung).
+ *
+ *  Ein eigenes Aggregat ist ein Monoid über den Knoten und muss anbieten:
+ *  -   Type                                 Datentyp des Aggregats
+ *  -   static Type identity ()              neutrales Element
+ *  -   static Type lift (Key k, Val& v)     Wert eines einzelnen Knotens
+ *  -   static Type combine (Type a, Type b) assoziative Verknüpfung,
+ *                                           a stammt von den kleineren Schlüsseln
+ */
+class NoAgg
+{
+public:
+    typedef NoAgg Type;
+};
+
+
+
+
+
+/*
+ *  Speicher für das Aggregat eines Unterbaums.
+ *  Wird vom Knoten geerbt; für NoAgg ist die Klasse leer
+ *  und das Aktualisieren verschwindet vollständig.
+ */
+template <typename Key, typename Val, typename Agg>
+class AVL_Aggregate
+{
+protected:
+    typename Agg::Type      aggregate;
+
+    static typename Agg::Type getAggregate (const AVL_Aggregate* p);
+    void updateAggregate (Key& k, Val& v, bool alive, const AVL_Aggregate* s, const AVL_Aggregate* g);
+};
+
+template <typename Key, typename Val>
+class AVL_Aggregate<Key, Val, NoAgg>
+{
+protected:
+    void updateAggregate (Key&, Val&, bool, const AVL_Aggregate*, const AVL_Aggregate*) {}
+};
+
+
+
+
+
+/*
+ *  Verweise auf die Elternknoten sind optional (fünfter Template-Parameter):
+ *  NoParent (Voreinstellung) spart den Zeiger, mit ParentLinks kennt jeder Knoten
+ *  seinen Elternknoten, und erase(Node*), next(Node*) und prev(Node*)
+ *  kommen ohne Suche von der Wurzel aus.
+ *  Nachgeführt werden die Verweise wie die Aggregate in update.
+ */
+class NoParent
+{
+};
+
+class ParentLinks
+{
+};
+
+template <typename Node, typename Links>
+class AVL_Parent
+{
+protected:
+    Node*                   parent;
+
+    void setParent (Node* p) { parent = p; }
+    bool isChildOf (Node* p) { return parent == p; }
+};
+
+template <typename Node>
+class AVL_Parent<Node, NoParent>
+{
+protected:
+    void setParent (Node*) {}
+    bool isChildOf (Node*) { return true; }
+};
+
+
+
+
+
+/*
+ *  Ein kleiner Thread-Pool mit Work-Stealing für die parallelen Durchläufe.
+ *
+ *  Jeder Worker (und der Aufrufer von run) hat eine eigene Warteschlange,
+ *  arbeitet sie von hinten ab und stiehlt, wenn sie leer ist,
+ *  von vorne aus den Warteschlangen der anderen.
+ *  Aufgaben dürfen selbst kein run aufrufen.
+ */
+class AVL_ThreadPool
+{
+protected:
+    class Queue
+    {
+    public:
+        mutex                       lock;
+        deque<function<void()>>     tasks;
+    };
+
+    vector<thread>          workers;
+    vector<Queue>           queues;     // workers.size() + 1, die letzte gehört dem Aufrufer
+    mutex                   lock;
+    mutex                   running;    // es läuft immer nur ein run gleichzeitig
+    condition_variable      wakeup;
+    condition_variable      finished;
+    atomic<size_t>          queued;     // noch nicht begonnene Aufgaben
+    atomic<size_t>          pending;    // noch nicht beendete Aufgaben
+    bool                    stop;
+    exception_ptr           error;
+
+    bool runOne (size_t self);
+    void work (size_t self);
+
+public:
+    AVL_ThreadPool (unsigned n = thread::hardware_concurrency());
+    ~AVL_ThreadPool ();
+    unsigned size ();
+    void run (vector<function<void()>>& tasks);
+
+    static AVL_ThreadPool& shared ();
+    static unsigned sharedSize ();
+};
+
+
+
+/*
+ *  Ein einzelner Hintergrund-Thread, der abgetrennte Unterbäume freigibt
+ *  (erase_range mit background). Die Aufträge laufen der Reihe nach;
+ *  wait wartet, bis alle bisherigen erledigt sind, und der Destruktor
+ *  (für shared am Programmende) arbeitet die Warteschlange noch ab.
+ */
+class AVL_Reclaimer
+{
+protected:
+    thread                  worker;
+    mutex                   lock;
+    condition_variable      wakeup;
+    condition_variable      idle;
+    deque<function<void()>> jobs;
+    bool                    busy;       // ein Auftrag läuft gerade
+    bool                    stop;
+
+    void work ();
+
+public:
+    AVL_Reclaimer ();
+    AVL_Reclaimer (const AVL_Reclaimer&) = delete;
+    ~AVL_Reclaimer ();
+    void post (function<void()> job);
+    void wait ();
+
+    static AVL_Reclaimer& shared ();
+};
+
+
+
+
+
+/*
+ *  Die Balancierungs-Strategien.
+ *  Sie bekommen Zugriff auf die Knoten (friend) und legen fest,
+ *  was im Feld balance steht, wie nach dem Einfügen und Löschen
+ *  rebalanciert wird und was check() prüft.
+ *
+ *  -   rebalance      wie bisher: Offset -1 (smaller) bzw. +1 (greater) für den Unterbaum,
+ *                     der gewachsen (insertNotRemove) oder geschrumpft ist;
+ *                     true, solange sich die Änderung nach oben fortsetzt
+ *  -   height         Höhe eines Unterbaums, wie sie aus den Knoten hervorgeht
+ *  -   childHeights   Höhen der Unterbäume eines Knotens der Höhe h
+ *  -   setHeights     Knoten für Unterbäume der Höhen hs und hg einrichten (join)
+ *  -   checkHeight    Knoten gegen die Höhen seiner Unterbäume prüfen,
+ *                     liefert seine eigene Höhe oder wirft
+ *
+ *  Bei WAVL ist die „Höhe“ der Rang + 1, die tatsächliche Höhe kann kleiner sein.
+ */
+
+/*
+ *  Klassischer AVL-Baum (Voreinstellung):
+ *  balance ist die Höhendifferenz greater - smaller, -1 .. +1.
+ */
+class AVL_Balancing
+{
+public:
+    template <typename Node> static bool rebalance (Node*& p, int offset, bool insertNotRemove);
+    template <typename Node> static int height (Node* p);
+    template <typename Node> static void childHeights (Node* p, int h, int& hs, int& hg);
+    template <typename Node> static void setHeights (Node* p, int hs, int hg);
+    template <typename Node> static int checkHeight (Node* p, int hs, int hg);
+};
+
+/*
+ *  Weak AVL (Haeupler, Sen, Tarjan):
+ *  balance ist der Rang, Rangdifferenzen zu den Kindern sind 1 oder 2,
+ *  Blätter haben den Rang 0 (fehlende Kinder zählen als Rang -1).
+ *  Einfügen verhält sich wie bei AVL, beim Löschen wird höchstens
+ *  zweimal rotiert und amortisiert O(1) oft der Rang geändert.
+ */
+class WAVL_Balancing
+{
+protected:
+    template <typename Node> static int rank (Node* p);
+    template <typename Node> static void rotate (Node*& p, bool smaller);
+
+public:
+    template <typename Node> static bool rebalance (Node*& p, int offset, bool insertNotRemove);
+    template <typename Node> static int height (Node* p);
+    template <typename Node> static void childHeights (Node* p, int h, int& hs, int& hg);
+    template <typename Node> static void setHeights (Node* p, int hs, int hg);
+    template <typename Node> static int checkHeight (Node* p, int hs, int hg);
+};
+
+
+
+
+
 /*
  *  Die Intanzvariablen werden dem Baum zugänglich gemacht (friend),
  *  dazu muss die Baumklasse hier schon vordefiniert sein.
  */
-template <typename Key, typename Val>
+template <typename Key, typename Val, typename Agg = NoAgg, typename Balancing = AVL_Balancing, typename Links = NoParent>
 class AVL_Tree;
 
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+class AVL_NodeHandle;
+
+template <typename Key, unsigned Bytes, typename Balancing>
+class AVL_BlockTree;
+
 
 
 
@@ -55,26 +302,64 @@ class AVL_Tree;
  *  Die Arbeitstiere sind hier als statische Methoden implementiert.
  *
  *  Von außen (öffentlich) lassen sich halt Knoten erzeugen und der Schlüssel abfragen.
- *  Um die zusätzlichen Werte (Val) wird sich nicht gekümmert.
+ *  Um die zusätzlichen Werte (Val) wird sich nicht gekümmert,
+ *  das Aggregat über den Unterbaum (Agg) wird aber stets nachgeführt,
+ *  ebenso die Eltern-Verweise (Links).
+ *  Wie nach dem Einfügen und Löschen ausbalanciert wird, bestimmt Balancing.
  */
-template <typename Key, typename Val>
-class AVL_Node : public Val
+template <typename Key, typename Val, typename Agg = NoAgg, typename Balancing = AVL_Balancing, typename Links = NoParent>
+class AVL_Node : public Val, public AVL_Aggregate<Key, Val, Agg>, public AVL_Parent<AVL_Node<Key, Val, Agg, Balancing, Links>, Links>
 {
-    friend AVL_Tree<Key, Val>;
+    friend AVL_Tree<Key, Val, Agg, Balancing, Links>;
+    friend AVL_NodeHandle<Key, Val, Agg, Balancing, Links>;
+    friend Balancing;
+    friend AVL_Balancing;    // eigene Strategien dürfen von diesen beiden ableiten
+    friend WAVL_Balancing;
+    template <typename, unsigned, typename> friend class AVL_BlockTree;
 
 protected:
     AVL_Node*               smaller;
     AVL_Node*               greater;
-    int                     balance;   // -1 .. +1 bei einem AVL-Baum
+    short                   balance;   // -1 .. +1 bei einem AVL-Baum, bei WAVL der Rang
+    bool                    dead;      // nur noch als Grabstein im Baum (lazy remove)
     Key                     key;
 
     static AVL_Node* find(AVL_Node* p, Key k);
     static bool rebalance (AVL_Node*& p, int offset, bool insertNotRemove);
     static bool insert (AVL_Node*& p, Key k, AVL_Node*& inserted);
-    static bool remove (AVL_Node*& p, Key k);
+    static bool remove (AVL_Node*& p, Key k, AVL_Node*& removed);
+    static void replace (AVL_Node*& p, Key k, AVL_Node* n);
+    static bool removeMin (AVL_Node*& p, AVL_Node*& min);
+    static AVL_Node* join (AVL_Node* l, int hl, AVL_Node* m, AVL_Node* r, int hr, int& h);
+    static void split (AVL_Node* p, int h, Key k, bool inclusive, AVL_Node*& l, int& hl, AVL_Node*& r, int& hr);
+    static void destroy (AVL_Node* p);
+    static void census (AVL_Node* p, size_t& nodes, size_t& dead);
+    static AVL_Node* build (vector<AVL_Node*>& nodes, size_t lo, size_t hi, int& h);
+    static void resetVal (AVL_Node* p, true_type);
+    static void resetVal (AVL_Node* p, false_type);
+    static void update (AVL_Node* p);
+    static void adopt (AVL_Node* p);
+    static void makeRoot (AVL_Node* p);
+    static AVL_Node*& parentLink (AVL_Node*& root, AVL_Node* p);
+    static bool erase (AVL_Node*& root, AVL_Node* x);
+    static AVL_Node* next (AVL_Node* p);
+    static AVL_Node* prev (AVL_Node* p);
+    static void refresh (AVL_Node* p, Key k);
+    static typename Agg::Type reduce (AVL_Node* p, Key lo, Key hi, bool lower, bool upper);
+
+    template <typename Function>
+    static void forEach (AVL_Node* p, Function& f);
+    static void partition (AVL_Node* p, int depth, vector<pair<AVL_Node*, bool>>& parts);
 
     // Zu Testzwecken …
     static int calcHeight (AVL_Node* p);
+    static int calcHeight (AVL_Node* p, int depth, vector<int>& heights, size_t& next);
+    static void checkParent (AVL_Node* p);
+    static bool inRange (AVL_Node* p, Key* lo, Key* hi);
+    static void checkLocal (AVL_Node* p, Key* lo, Key* hi);
+    static void checkAround (AVL_Node* p, Key* lo, Key* hi);
+    static void checkPath (AVL_Node* p, Key k);
+    static AVL_Node* checkNext (AVL_Node* p, Key k, bool first);
     static void space8 (unsigned n = 1);
     static void display (AVL_Node* p, int h, char c = 'W');
 
@@ -87,29 +372,282 @@ public:
 
 
 
+/*
+ *  Ein Finger merkt sich den Pfad von der Wurzel zum zuletzt besuchten Knoten,
+ *  zu jeder Stufe auch, welche Vorfahren den Unterbaum nach unten und oben begrenzen.
+ *  Die Suche beginnt dann dort und steigt nur so weit auf, bis der Unterbaum
+ *  den gesuchten Schlüssel enthält  =>  bei fast sortierter Eingabe nur wenige Schritte.
+ *
+ *  Ändert sich der Baum an anderer Stelle, erkennt der Baum das an version
+ *  und beginnt wieder bei der Wurzel; ebenso, wenn der Finger
+ *  zuletzt in einem anderen Baum (tree) benutzt wurde.
+ */
+template <typename Key, typename Val, typename Agg = NoAgg, typename Balancing = AVL_Balancing, typename Links = NoParent>
+class AVL_Finger
+{
+    friend AVL_Tree<Key, Val, Agg, Balancing, Links>;
+    using Node = AVL_Node<Key, Val, Agg, Balancing, Links>;
+    using Tree = AVL_Tree<Key, Val, Agg, Balancing, Links>;
+
+protected:
+    struct Step
+    {
+        Node*               node;
+        int                 lower;   // Stufe der unteren Schranke, -1: keine
+        int                 upper;   // Stufe der oberen Schranke, -1: keine
+    };
+
+    vector<Step>            path;
+    unsigned long           version;
+    const Tree*             tree;      // Baum, in dem zuletzt gesucht wurde, nullptr: noch nie
+
+public:
+    AVL_Finger ();
+};
+
+
+
+
+
+/*
+ *  Ein mit extract aus dem Baum ausgehängter Knoten, dem das Handle gehört.
+ *  Mit insert(move(handle)) wird genau dieser Knoten wieder eingehängt,
+ *  in denselben oder einen anderen Baum gleichen Typs und auf Wunsch
+ *  unter einem neuen Schlüssel (setKey) – ohne new, delete oder Kopie der Val-Werte.
+ *  Wird das Handle vorher zerstört, wird der Knoten freigegeben.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+class AVL_NodeHandle
+{
+    friend AVL_Tree<Key, Val, Agg, Balancing, Links>;
+    using Node = AVL_Node<Key, Val, Agg, Balancing, Links>;
+
+protected:
+    Node*                   node;
+
+    explicit AVL_NodeHandle (Node* p);
+
+public:
+    AVL_NodeHandle ();
+    AVL_NodeHandle (AVL_NodeHandle&& h);
+    AVL_NodeHandle (const AVL_NodeHandle&) = delete;
+    ~AVL_NodeHandle ();
+    AVL_NodeHandle& operator= (AVL_NodeHandle&& h);
+
+    bool empty ();
+    Node* get ();
+    Key getKey ();
+    void setKey (Key k);
+};
+
+
+
+
+
+/*
+ *  Aufzeichnung der Operationen eines Baums in eine kompakte Binärdatei,
+ *  um sie später (FastAVL-replay) mit anderen Baum-Varianten nachzuspielen.
+ *
+ *  Die Datei beginnt mit einem AVL_TraceHeader, danach folgt je Operation
+ *  ein Byte für die Art und der Schlüssel, so wie er im Speicher steht
+ *  (der Schlüssel darf also keine Zeiger enthalten).
+ */
+struct AVL_TraceHeader
+{
+    char                    magic[4];   // "AVLT"
+    unsigned char           version;    // 1
+    unsigned char           keySize;    // sizeof(Key)
+    unsigned char           reserved[2];
+};
+
+template <typename Key>
+class AVL_Recorder
+{
+protected:
+    ofstream                out;
+    vector<char>            buffer;
+    static const size_t     bufferSize = 1 << 16;
+
+public:
+    enum Op { Insert, Remove, Find, SafeInsert, SafeRemove };
+
+    AVL_Recorder (const char* fileName);
+    AVL_Recorder (const AVL_Recorder&) = delete;
+    ~AVL_Recorder ();
+    void log (Op op, Key k);
+    void flush ();
+};
+
+
+
+
+
 /*
  *  Der Baum.
  *  Quasi die GUI für obige Knoten;
  *  in diesem wird die Wurzel und die Höhe des Baums verwaltet.
  */
-template <typename Key, typename Val>
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
 class AVL_Tree
 {
-    using Node = AVL_Node<Key, Val>;
+    using Node = AVL_Node<Key, Val, Agg, Balancing, Links>;
+
+public:
+    using Finger = AVL_Finger<Key, Val, Agg, Balancing, Links>;
+    using Handle = AVL_NodeHandle<Key, Val, Agg, Balancing, Links>;
 
 protected:
     Node*                   root;
     int                     height;
 
+    // für lazy remove
+    size_t                  nodes;         // Knoten im Baum, Grabsteine eingeschlossen
+    size_t                  tombstones;    // davon als gelöscht markiert
+    double                  purgeRatio;    // 0: sofort löschen, sonst Anteil, ab dem aufgeräumt wird
+
+    // Knoten und Grabsteine, die erase_range im Hintergrund noch zählt und freigibt
+    vector<future<pair<size_t, size_t>>>    censuses;
+
+    unsigned long           version;       // zählt die Umbauten, macht alte Finger ungültig
+
+    AVL_Recorder<Key>*      recorder;      // nullptr: nichts aufzeichnen
+
+    // für checkStep
+    Key                     cursor;        // zuletzt geprüfter Schlüssel
+    bool                    cursorValid;   // false: nächster Durchgang beginnt vorne
+    vector<Key>             touched;       // seitdem geänderte Schlüssel (höchstens maxTouched)
+    static const size_t     maxTouched = 64;
+
+    int splitDepth (unsigned threads);
+    AVL_ThreadPool* splitPool (AVL_ThreadPool* pool, int& depth);
+    template <typename Function>
+    void forEachIn (Function f, AVL_ThreadPool* pool);
+    template <typename T, typename Map, typename Combine>
+    T reduceIn (T identity, Map map, Combine combine, AVL_ThreadPool* pool);
+    void checkIn (AVL_ThreadPool* pool);
+    void touch (Key k);
+    void mark (Node* p, bool dead);
+    void settle (bool wait);
+    Node* insertKey (Key k);
+    void removeKey (Key k);
+    Node* descend (Finger& f, Key k);
+    Node*& link (Finger& f, size_t i);
+
 public:
     AVL_Tree ();
     int getHeight ();
+    size_t size ();
 
     Node* find (Key k);
     Node* insert (Key k);
     void remove (Key k);
     Node* safeInsert (Key k);
     void safeRemove (Key k);
+    Node* find_near (Finger& finger, Key k);
+    Node* insert (Finger& hint, Key k);
+    void remove (Finger& hint, Key k);
+    void erase (Node* p);
+    Handle extract (Key k);
+    Node* insert (Handle&& h);
+    Node* next (Node* p);
+    Node* prev (Node* p);
+    void erase_range (Key lo, Key hi, bool background = false);
+    void setLazyRemove (double ratio);
+    void purge ();
+    void setRecorder (AVL_Recorder<Key>* r);
+    void refresh (Key k);
+    typename Agg::Type reduce (Key lo, Key hi);
+
+    template <typename Function>
+    void for_each (Function f);
+    template <typename Function>
+    void parallel_for_each (Function f);
+    template <typename Function>
+    void parallel_for_each (Function f, AVL_ThreadPool& pool);
+    template <typename T, typename Map, typename Combine>
+    T parallel_reduce (T identity, Map map, Combine combine);
+    template <typename T, typename Map, typename Combine>
+    T parallel_reduce (T identity, Map map, Combine combine, AVL_ThreadPool& pool);
+
+    bool checkStep (unsigned budget = 32);
+
+    // Zu Testzwecken …
+    void check ();
+    void check (AVL_ThreadPool& pool);
+    void display ();
+};
+
+
+
+
+
+/*
+ *  Der Inhalt eines Knotens im Block-Baum:
+ *  ein sortierter Block von Schlüsseln, Bytes groß (ein oder zwei Cache-Lines)
+ *  und an einer Cache-Line ausgerichtet.
+ *  Der Block hängt am Knoten, statt in ihm zu liegen, damit die Knoten,
+ *  über die abgestiegen wird, klein bleiben und dicht in den Cache passen;
+ *  erst im Zielknoten wird der Block selbst gelesen.
+ *  keys[0] ist immer zugleich der Schlüssel des Knotens.
+ */
+template <typename Key, unsigned Bytes>
+class AVL_Block
+{
+public:
+    static const unsigned   capacity = Bytes / sizeof(Key);
+
+    Key*                    keys;
+    unsigned                count;
+
+    AVL_Block ();
+    AVL_Block (const AVL_Block&) = delete;
+    AVL_Block& operator= (const AVL_Block&) = delete;
+    ~AVL_Block ();
+    unsigned lowerBound (Key k);
+    void displayVal ();
+};
+
+
+
+/*
+ *  Block-Baum: ein AVL-Baum über Blöcken von Schlüsseln (ohne Werte).
+ *  Eine Suche braucht nur etwa log(n / capacity) Zeigersprünge
+ *  und sucht dann innerhalb eines Blocks, für ganzzahlige Schlüssel
+ *  mit SIMD-Vergleichen.
+ *  Volle Blöcke werden beim Einfügen halbiert, fast leere Blöcke beim Löschen
+ *  mit einem Nachbarn zusammengelegt oder von ihm aufgefüllt.
+ *
+ *  Die Schnittstelle entspricht der von AVL_Tree,
+ *  statt Knoten werden aber Zeiger auf die Schlüssel im Block geliefert
+ *  (gültig bis zur nächsten Änderung).
+ */
+template <typename Key, unsigned Bytes = 128, typename Balancing = AVL_Balancing>
+class AVL_BlockTree : protected AVL_Tree<Key, AVL_Block<Key, Bytes>, NoAgg, Balancing>
+{
+    using Block = AVL_Block<Key, Bytes>;
+    using Tree  = AVL_Tree<Key, Block, NoAgg, Balancing>;
+    using Node  = AVL_Node<Key, Block, NoAgg, Balancing>;
+
+    static_assert(Block::capacity >= 4, "Block too small for key type!");
+
+protected:
+    Node* floor (Key k);
+    Node* next (Node* p);
+    Node* prev (Node* p);
+    void merge (Node* p);
+
+public:
+    AVL_BlockTree ();
+    int getHeight ();
+
+    const Key* find (Key k);
+    const Key* insert (Key k);
+    void remove (Key k);
+    const Key* safeInsert (Key k);
+    void safeRemove (Key k);
+
+    template <typename Function>
+    void for_each (Function f);
 
     // Zu Testzwecken …
     void check ();
@@ -120,49 +658,462 @@ public:
 
 
 
+/*
+ *  Schreibzugriff vieler Threads auf einen Baum per Flat Combining:
+ *  Jeder Thread legt seine Operation in einem eigenen Fach (Slot, je eine Cache-Line) ab.
+ *  Wer gerade die Combiner-Rolle bekommt, sammelt alle ausstehenden Operationen ein,
+ *  sortiert sie nach Schlüssel und arbeitet sie mit einem Finger in einem Zug ab
+ *  (Einfügen und Löschen gleichermaßen); die übrigen Threads warten nur auf ihr eigenes Fach.
+ *  So wandert keine Sperre zwischen den Kernen hin und her und der Baum bleibt
+ *  im Cache des Combiners.
+ *
+ *  Solange der Combiner in Gebrauch ist, darf nur über ihn auf den Baum zugegriffen werden.
+ */
+template <typename Key, typename Val = NoVal, typename Agg = NoAgg, typename Balancing = AVL_Balancing, typename Links = NoParent>
+class AVL_Combiner
+{
+    using Tree = AVL_Tree<Key, Val, Agg, Balancing, Links>;
+
+protected:
+    enum State { Free, Claimed, Posted, Done };
+    enum Op { Insert, Remove, Find };
+
+    class Slot
+    {
+    public:
+        atomic<int>             state;
+        Op                      op;
+        Key                     key;
+        bool                    result;
+        exception_ptr           error;
+    };
+
+    class Role      // gibt die Combiner-Rolle auch bei einer Ausnahme wieder frei
+    {
+    public:
+        atomic<bool>&           busy;
+
+        Role (atomic<bool>& b) : busy(b) {}
+        ~Role () { busy.store(false, memory_order_release); }
+    };
+
+    Tree&                   tree;
+    char*                   slots;      // n Fächer im Abstand stride, an Cache-Lines ausgerichtet
+    size_t                  stride;
+    unsigned                n;
+    atomic<bool>            busy;       // die Combiner-Rolle ist vergeben
+    vector<Slot*>           batch;      // nur vom Combiner benutzt
+    typename Tree::Finger   finger;
+
+    Slot* slot (unsigned i);
+    bool apply (Op op, Key k);
+    void combine ();
+
+public:
+    AVL_Combiner (Tree& t, unsigned size = 64);
+    AVL_Combiner (const AVL_Combiner&) = delete;
+    ~AVL_Combiner ();
+
+    bool insert (Key k);
+    bool remove (Key k);
+    bool find (Key k);
+};
+
+
+
+
+
+#if __cplusplus >= 201402L
+/*
+ *  Statischer Baum für Schlüsselmengen, die schon beim Übersetzen feststehen (ab C++14).
+ *  Der Konstruktor ist constexpr: er sortiert die Schlüssel, entfernt Doppelte
+ *  und legt sie als vollständig ausgeglichenen Baum in einem Feld ab
+ *  (Eytzinger-Anordnung: Kinder von i an 2i und 2i+1, die Wurzel an 1).
+ *  Ein constexpr-Objekt liegt damit fertig in den Nur-Lese-Daten,
+ *  ohne new und ohne Aufwand beim Programmstart.
+ *
+ *  find und for_each entsprechen denen von AVL_BlockTree.
+ *  Key muss ein Literaltyp sein und einen const-Operator < haben.
+ */
+template <typename Key, size_t N>
+class AVL_StaticTree
+{
+protected:
+    Key                     keys[N + 1];   // keys[0] bleibt unbenutzt
+    size_t                  count;
+
+    constexpr size_t layout (const Key* sorted, size_t i, size_t next);
+    template <typename Function>
+    void forEach (size_t i, Function& f) const;
+
+public:
+    constexpr AVL_StaticTree (const Key (&k)[N]);
+
+    constexpr size_t size () const;
+    constexpr int getHeight () const;
+    constexpr const Key* find (Key k) const;
+
+    template <typename Function>
+    void for_each (Function f) const;
+};
+
+template <typename Key, size_t N>
+constexpr AVL_StaticTree<Key, N> makeStaticTree (const Key (&k)[N]);
+#endif
+
+
+
+
+
 /*
  *  ======================================================================
- *  Die statischen Knoten-Methoden
+ *  Die Methoden des Thread-Pools
  *  ======================================================================
  */
 
 
 
 /*
- *  Iterative Suche nach einem Schlüssel.
+ *  Konstruktor – startet n-1 Worker, der Aufrufer von run arbeitet mit
  */
-
-template <typename Key, typename Val>
-AVL_Node<Key, Val>* AVL_Node<Key, Val> :: find (AVL_Node* p, Key k)
+inline AVL_ThreadPool :: AVL_ThreadPool (unsigned n) : queues(max(n, 1u))
 {
-    while (p != nullptr && k != p->key) {
-        if (k < p->key) {
-            p = p->smaller;
-        }
-        else {
-            p = p->greater;
-        }
+    queued  = 0;
+    pending = 0;
+    stop    = false;
+    for (size_t i = 0; i + 1 < queues.size(); i++) {
+        workers.push_back(thread(&AVL_ThreadPool::work, this, i));
     }
-    return p;
 }
 
 
 
 /*
- *  Offset zur Balance des Knotens addieren und nötigenfalls
- *  (je nachdem, ob eingefügt oder gelöscht wird)
- *  den Knoten rebalancieren.
- *  Wird true zurückgegeben, setzt sich die Höhenänderung fort.
+ *  Destruktor – Worker wecken und beenden
  */
-template <typename Key, typename Val>
-bool AVL_Node<Key, Val> :: rebalance (AVL_Node*& p, int offset, bool insertNotRemove)
+inline AVL_ThreadPool :: ~AVL_ThreadPool ()
 {
-    AVL_Node*               q;
-    AVL_Node*               r;
-    int                     bal;
-
-    if (offset != -1 && offset != +1) {
-        throw "Illegal offset while rebalancing!";
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    wakeup.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+
+
+/*
+ *  Anzahl der Threads, die an einem run beteiligt sind (einschließlich Aufrufer)
+ */
+inline unsigned AVL_ThreadPool :: size ()
+{
+    return queues.size();
+}
+
+
+
+/*
+ *  Eine Aufgabe aus der eigenen Warteschlange (von hinten)
+ *  oder aus einer fremden (von vorne) holen und ausführen.
+ *  Liefert false, wenn nirgends mehr etwas zu tun war.
+ */
+inline bool AVL_ThreadPool :: runOne (size_t self)
+{
+    function<void()>        task;
+
+    for (size_t i = 0; i < queues.size() && ! task; i++) {
+        Queue& q = queues[(self + i) % queues.size()];
+        lock_guard<mutex> guard(q.lock);
+        if (! q.tasks.empty()) {
+            if (i == 0) {
+                task = move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+            else {
+                task = move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+    }
+    if (! task) {
+        return false;
+    }
+    queued--;
+    try {
+        task();
+    } catch (...) {
+        lock_guard<mutex> guard(lock);
+        if (! error) {
+            error = current_exception();
+        }
+    }
+    if (--pending == 0) {
+        lock_guard<mutex> guard(lock);
+        finished.notify_all();
+    }
+    return true;
+}
+
+
+
+/*
+ *  Hauptschleife eines Workers
+ */
+inline void AVL_ThreadPool :: work (size_t self)
+{
+    for (;;) {
+        {
+            unique_lock<mutex> guard(lock);
+            wakeup.wait(guard, [this] { return stop || queued > 0; });
+            if (stop) {
+                return;
+            }
+        }
+        while (runOne(self)) {
+        }
+    }
+}
+
+
+
+/*
+ *  Alle Aufgaben reihum auf die Warteschlangen verteilen,
+ *  mitarbeiten und warten, bis alle erledigt sind.
+ *  Die erste aufgetretene Ausnahme wird anschließend weitergeworfen.
+ */
+inline void AVL_ThreadPool :: run (vector<function<void()>>& tasks)
+{
+    lock_guard<mutex>       serial(running);
+    size_t                  self = queues.size() - 1;
+    exception_ptr           e;
+
+    if (tasks.empty()) {
+        return;
+    }
+    /*
+     *  Die Zähler müssen stehen, bevor die erste Aufgabe sichtbar wird:
+     *  ein Worker, der noch vom letzten run in runOne kreist,
+     *  kann sie sonst schon holen und pending unter 0 zählen.
+     */
+    {
+        lock_guard<mutex> guard(lock);
+        pending = tasks.size();
+        queued  = tasks.size();
+    }
+    for (size_t i = 0; i < tasks.size(); i++) {
+        Queue& q = queues[i % queues.size()];
+        lock_guard<mutex> guard(q.lock);
+        q.tasks.push_back(move(tasks[i]));
+    }
+    wakeup.notify_all();
+
+    while (runOne(self)) {
+    }
+    {
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [this] { return pending == 0; });
+        e = error;
+        error = nullptr;
+    }
+    tasks.clear();
+    if (e) {
+        rethrow_exception(e);
+    }
+}
+
+
+
+/*
+ *  Der gemeinsame Pool aller Bäume, wird beim ersten Gebrauch angelegt
+ */
+inline AVL_ThreadPool& AVL_ThreadPool :: shared ()
+{
+    static AVL_ThreadPool pool;
+    return pool;
+}
+
+
+
+/*
+ *  Größe, die shared haben wird (oder hat) – ohne den Pool anzulegen
+ */
+inline unsigned AVL_ThreadPool :: sharedSize ()
+{
+    return max(thread::hardware_concurrency(), 1u);
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die Methoden des Hintergrund-Freigebers
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktor – startet den Thread
+ */
+inline AVL_Reclaimer :: AVL_Reclaimer ()
+{
+    busy   = false;
+    stop   = false;
+    worker = thread(&AVL_Reclaimer::work, this);
+}
+
+
+
+/*
+ *  Destruktor – erledigt noch alle Aufträge und beendet den Thread
+ */
+inline AVL_Reclaimer :: ~AVL_Reclaimer ()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+
+
+/*
+ *  Hauptschleife: Aufträge der Reihe nach ausführen, bis stop und nichts mehr zu tun ist.
+ *  Ausnahmen der Aufträge werden verschluckt, es gibt niemanden, der sie fangen könnte.
+ */
+inline void AVL_Reclaimer :: work ()
+{
+    unique_lock<mutex>      guard(lock);
+
+    for (;;) {
+        wakeup.wait(guard, [this] { return stop || ! jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+        function<void()> job = move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        guard.unlock();
+        try {
+            job();
+        } catch (...) {
+        }
+        guard.lock();
+        busy = false;
+        if (jobs.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+
+
+
+/*
+ *  Auftrag anhängen
+ */
+inline void AVL_Reclaimer :: post (function<void()> job)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        jobs.push_back(move(job));
+    }
+    wakeup.notify_one();
+}
+
+
+
+/*
+ *  Warten, bis alle bisher angehängten Aufträge erledigt sind
+ */
+inline void AVL_Reclaimer :: wait ()
+{
+    unique_lock<mutex>      guard(lock);
+
+    idle.wait(guard, [this] { return jobs.empty() && ! busy; });
+}
+
+
+
+/*
+ *  Der gemeinsame Freigeber aller Bäume, wird beim ersten Gebrauch angelegt
+ */
+inline AVL_Reclaimer& AVL_Reclaimer :: shared ()
+{
+    static AVL_Reclaimer reclaimer;
+    return reclaimer;
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die Methoden des Aggregat-Speichers
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Aggregat eines (möglicherweise leeren) Unterbaums
+ */
+template <typename Key, typename Val, typename Agg>
+typename Agg::Type AVL_Aggregate<Key, Val, Agg> :: getAggregate (const AVL_Aggregate* p)
+{
+    return p == nullptr ? Agg::identity() : p->aggregate;
+}
+
+
+
+/*
+ *  Aggregat aus kleinerem Unterbaum s, eigenem Wert und größerem Unterbaum g
+ *  (in dieser Reihenfolge, combine muss nicht kommutativ sein);
+ *  ein als gelöscht markierter Knoten (nicht alive) trägt nichts bei.
+ */
+template <typename Key, typename Val, typename Agg>
+void AVL_Aggregate<Key, Val, Agg> :: updateAggregate (Key& k, Val& v, bool alive, const AVL_Aggregate* s, const AVL_Aggregate* g)
+{
+    aggregate = Agg::combine(Agg::combine(getAggregate(s), alive ? Agg::lift(k, v) : Agg::identity()), getAggregate(g));
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die Balancierungs-Strategien
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Offset zur Balance des Knotens addieren und nötigenfalls
+ *  (je nachdem, ob eingefügt oder gelöscht wird)
+ *  den Knoten rebalancieren.
+ *  Wird true zurückgegeben, setzt sich die Höhenänderung fort.
+ *
+ *  Die Aggregate der nach unten rotierten Knoten werden hier neu berechnet,
+ *  das der (neuen) Wurzel p muss der Aufrufer nachführen.
+ */
+template <typename Node>
+bool AVL_Balancing :: rebalance (Node*& p, int offset, bool insertNotRemove)
+{
+    Node*                   q;
+    Node*                   r;
+    int                     bal;
+
+    if (offset != -1 && offset != +1) {
+        throw "Illegal offset while rebalancing!";
     }
     if (p == nullptr) {
         throw "Don’t rebalance empty trees!";
@@ -215,6 +1166,7 @@ bool AVL_Node<Key, Val> :: rebalance (AVL_Node*& p, int offset, bool insertNotRe
             q->balance = (bal == 0) ? +1 : 0;   // ? <> : ()
             p->smaller = q->greater;
             q->greater = p;
+            Node::update(p);   // p ist jetzt ein Kind von q
             p = q;
             return (bal == 0) == insertNotRemove;
         }
@@ -245,6 +1197,8 @@ bool AVL_Node<Key, Val> :: rebalance (AVL_Node*& p, int offset, bool insertNotRe
             r->greater = p;
             q->greater = r->smaller;
             r->smaller = q;
+            Node::update(q);   // q und p sind jetzt Kinder von r
+            Node::update(p);
             p = r;
             return ! insertNotRemove;
         }
@@ -259,6 +1213,7 @@ bool AVL_Node<Key, Val> :: rebalance (AVL_Node*& p, int offset, bool insertNotRe
             q->balance = (bal == 0) ? -1 : 0;
             p->greater = q->smaller;
             q->smaller = p;
+            Node::update(p);
             p = q;
             return (bal == 0) == insertNotRemove;
         }
@@ -272,6 +1227,8 @@ bool AVL_Node<Key, Val> :: rebalance (AVL_Node*& p, int offset, bool insertNotRe
             r->smaller = p;
             q->smaller = r->greater;
             r->greater = q;
+            Node::update(q);
+            Node::update(p);
             p = r;
             return ! insertNotRemove;
         }
@@ -283,164 +1240,2965 @@ bool AVL_Node<Key, Val> :: rebalance (AVL_Node*& p, int offset, bool insertNotRe
 
 
 /*
- *  Schlüssel k in Baum p einfügen.
- *  inserted enthält anschließend einen Zeiger auf den neuen Knoten.
- *  Es wird true zurückgegeben, solange sich die Höhenänderung fortsetzt.
+ *  Höhe des Baums p, wie sie sich aus den Balancen ergibt:
+ *  Es wird immer in den (laut Balance) höheren Unterbaum abgestiegen  =>  O(log n)
+ *  Stimmt bei jedem Knoten die Balance mit diesen Höhen überein (checkHeight),
+ *  ist es auch die tatsächliche Höhe.
+ */
+template <typename Node>
+int AVL_Balancing :: height (Node* p)
+{
+    int                     h = 0;
+
+    while (p != nullptr) {
+        p = (p->balance >= 0) ? p->greater : p->smaller;
+        h++;
+    }
+    return h;
+}
+
+
+
+/*
+ *  Höhen der Unterbäume aus der Balance
+ */
+template <typename Node>
+void AVL_Balancing :: childHeights (Node* p, int h, int& hs, int& hg)
+{
+    hs = (p->balance <= 0) ? h - 1 : h - 2;
+    hg = (p->balance >= 0) ? h - 1 : h - 2;
+}
+
+
+
+/*
+ *  Balance für Unterbäume der Höhen hs und hg (dürfen sich höchstens um eins unterscheiden)
+ */
+template <typename Node>
+void AVL_Balancing :: setHeights (Node* p, int hs, int hg)
+{
+    p->balance = hg - hs;
+}
+
+
+
+/*
+ *  AVL-Kriterium und Balance gegenüber den Höhen der Unterbäume prüfen
+ */
+template <typename Node>
+int AVL_Balancing :: checkHeight (Node* p, int hs, int hg)
+{
+    if (abs(hs - hg) > 1) {
+        throw "No AVL tree!";
+    }
+    else if (hg - hs != p->balance) {
+        throw "Balance not in line!";
+    }
+    return max(hs, hg) + 1;
+}
+
+
+
+/*
+ *  Rang eines (möglicherweise leeren) Unterbaums
+ */
+template <typename Node>
+int WAVL_Balancing :: rank (Node* p)
+{
+    return p == nullptr ? -1 : p->balance;
+}
+
+
+
+/*
+ *  Das Kind smaller (bzw. greater) von p nach oben rotieren;
+ *  das Aggregat von p wird nachgeführt, das der neuen Wurzel nicht.
+ */
+template <typename Node>
+void WAVL_Balancing :: rotate (Node*& p, bool smaller)
+{
+    Node*                   q;
+
+    if (smaller) {
+        q = p->smaller;
+        p->smaller = q->greater;
+        q->greater = p;
+    }
+    else {
+        q = p->greater;
+        p->greater = q->smaller;
+        q->smaller = p;
+    }
+    Node::update(p);
+    p = q;
+}
+
+
+
+/*
+ *  Rebalancieren über die Rangdifferenzen.
+ *  x ist der Unterbaum, dessen Rang sich geändert hat, y sein Geschwister.
+ *
+ *  Einfügen (x wurde befördert):
+ *  -   Rangdifferenz von x jetzt 1                =>  fertig
+ *  -   0 und y hat 1                              =>  p befördern, weiter oben prüfen
+ *  -   0 und y hat 2                              =>  Einfach- oder Doppelrotation, fertig
+ *
+ *  Löschen (Rang von x um eins gesunken):
+ *  -   Rangdifferenz von x jetzt 3 und y hat 2    =>  p zurückstufen, weiter oben prüfen
+ *  -   3, y hat 1 und ist ein 2,2-Knoten          =>  p und y zurückstufen, weiter oben prüfen
+ *  -   3, sonst                                   =>  Einfach- oder Doppelrotation, fertig
+ *  -   p ist ein Blatt mit Rang 1 (2,2-Blatt)     =>  p zurückstufen, weiter oben prüfen
+ */
+template <typename Node>
+bool WAVL_Balancing :: rebalance (Node*& p, int offset, bool insertNotRemove)
+{
+    Node*                   x;
+    Node*                   y;
+    Node*                   outer;   // Kind von x (bzw. y) auf der Außenseite
+    Node*                   inner;   // und auf der Innenseite
+    bool                    left;    // x ist p->smaller
+    int                     r;
+
+    if (offset != -1 && offset != +1) {
+        throw "Illegal offset while rebalancing!";
+    }
+    if (p == nullptr) {
+        throw "Don’t rebalance empty trees!";
+    }
+    left = insertNotRemove ? (offset == -1) : (offset == +1);
+    x = left ? p->smaller : p->greater;
+    y = left ? p->greater : p->smaller;
+    r = p->balance;
+
+    if (insertNotRemove) {
+        if (r - rank(x) != 0) {
+            return false;
+        }
+        if (r - rank(y) == 1) {
+            p->balance++;
+            return true;
+        }
+        outer = left ? x->smaller : x->greater;
+        inner = left ? x->greater : x->smaller;
+        if (r - rank(outer) == 1) {
+            /*
+             *  Einfachrotation: x wird Wurzel, p sein Kind.
+             *  Ist auch inner Rangdifferenz 1 (nur beim join möglich),
+             *  behält p seinen Rang und x wird befördert.
+             */
+            Node* q = p;
+            rotate(p, left);
+            if (r - rank(inner) == 1) {
+                x->balance++;
+                return true;
+            }
+            q->balance--;
+            return false;
+        }
+        else {
+            /*
+             *  Doppelrotation: inner wird Wurzel mit dem Rang r,
+             *  x und p werden Kinder mit dem Rang r-1.
+             */
+            Node* q = p;
+            rotate(left ? p->smaller : p->greater, ! left);
+            rotate(p, left);
+            inner->balance++;
+            x->balance--;
+            q->balance--;
+            return false;
+        }
+    }
+    else {
+        if (r - rank(x) == 2 && p->smaller == nullptr && p->greater == nullptr) {
+            p->balance--;   // 2,2-Blatt
+            return true;
+        }
+        if (r - rank(x) != 3) {
+            return false;
+        }
+        if (r - rank(y) == 2) {
+            p->balance--;
+            return true;
+        }
+        outer = left ? y->greater : y->smaller;
+        inner = left ? y->smaller : y->greater;
+        if (r - 1 - rank(outer) == 2 && r - 1 - rank(inner) == 2) {
+            p->balance--;
+            y->balance--;
+            return true;
+        }
+        if (r - 1 - rank(outer) == 1) {
+            /*
+             *  Einfachrotation: y wird Wurzel mit dem Rang r,
+             *  p sein Kind mit dem Rang r-1 (bzw. 0, falls es ein Blatt wird).
+             */
+            Node* q = p;
+            rotate(p, ! left);
+            y->balance++;
+            q->balance = (q->smaller == nullptr && q->greater == nullptr) ? 0 : r - 1;
+            return false;
+        }
+        else {
+            /*
+             *  Doppelrotation: inner wird Wurzel mit dem Rang r,
+             *  y und p werden Kinder mit dem Rang r-2.
+             */
+            Node* q = p;
+            rotate(left ? p->greater : p->smaller, left);
+            rotate(p, ! left);
+            inner->balance = r;
+            y->balance--;
+            q->balance = r - 2;
+            return false;
+        }
+    }
+}
+
+
+
+/*
+ *  Bei WAVL steht die Höhe (Rang + 1) direkt im Knoten  =>  O(1)
+ */
+template <typename Node>
+int WAVL_Balancing :: height (Node* p)
+{
+    return rank(p) + 1;
+}
+
+
+
+/*
+ *  Höhen der Unterbäume aus deren Rängen
+ */
+template <typename Node>
+void WAVL_Balancing :: childHeights (Node* p, int, int& hs, int& hg)
+{
+    hs = rank(p->smaller) + 1;
+    hg = rank(p->greater) + 1;
+}
+
+
+
+/*
+ *  Rang für Unterbäume der Höhen hs und hg (dürfen sich höchstens um eins unterscheiden)
+ */
+template <typename Node>
+void WAVL_Balancing :: setHeights (Node* p, int hs, int hg)
+{
+    p->balance = max(hs, hg);
+}
+
+
+
+/*
+ *  Rangdifferenzen 1 oder 2 und Rang 0 bei Blättern prüfen
+ */
+template <typename Node>
+int WAVL_Balancing :: checkHeight (Node* p, int hs, int hg)
+{
+    int                     h = p->balance + 1;
+
+    if (h - hs < 1 || h - hs > 2 || h - hg < 1 || h - hg > 2) {
+        throw "No WAVL tree!";
+    }
+    else if (hs == 0 && hg == 0 && p->balance != 0) {
+        throw "Rank not in line!";
+    }
+    return h;
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die statischen Knoten-Methoden
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Iterative Suche nach einem Schlüssel.
+ */
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Node<Key, Val, Agg, Balancing, Links> :: find (AVL_Node* p, Key k)
+{
+    while (p != nullptr && k != p->key) {
+        if (k < p->key) {
+            p = p->smaller;
+        }
+        else {
+            p = p->greater;
+        }
+    }
+    return p;
+}
+
+
+
+/*
+ *  Offset zur Balance des Knotens addieren und nötigenfalls
+ *  (je nachdem, ob eingefügt oder gelöscht wird)
+ *  den Knoten rebalancieren – nach der jeweiligen Strategie.
+ *  Wird true zurückgegeben, setzt sich die Höhenänderung fort.
+ *
+ *  Die Aggregate der nach unten rotierten Knoten werden dabei neu berechnet,
+ *  das der (neuen) Wurzel p muss der Aufrufer nachführen.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Node<Key, Val, Agg, Balancing, Links> :: rebalance (AVL_Node*& p, int offset, bool insertNotRemove)
+{
+    return Balancing::rebalance(p, offset, insertNotRemove);
+}
+
+
+
+/*
+ *  Schlüssel k in Baum p einfügen.
+ *  Ist inserted nicht nullptr, wird dieser (ausgehängte) Knoten eingehängt,
+ *  sonst ein neuer angelegt; inserted zeigt anschließend auf den Knoten.
+ *  Es wird true zurückgegeben, solange sich die Höhenänderung fortsetzt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Node<Key, Val, Agg, Balancing, Links> :: insert (AVL_Node*& p, Key k, AVL_Node*& inserted)
+{
+    bool                    changed = false;   // Höhenänderung abgefangen
+
+    if (p == nullptr) {
+        if (inserted == nullptr) {
+            inserted = new AVL_Node(k);   // neuen Knoten anlegen und zusätzlich in inserted merken
+            if (inserted == nullptr) {
+                throw "Out of memory!";
+            }
+        }
+        p = inserted;
+        update(p);
+        return true;   // Höhenänderung durch den neuen Knoten
+    }
+    else if (k < p->key) {
+        if (insert(p->smaller, k, inserted)) {
+            changed = rebalance(p, -1, true);
+        }
+    }
+    else if (k > p->key) {
+        if (insert(p->greater, k, inserted)) {
+            changed = rebalance(p, +1, true);
+        }
+    }
+    else {
+        throw "Key to insert already in tree!";
+    }
+    update(p);   // Aggregat ändert sich auch, wenn die Höhe gleich bleibt
+    return changed;
+}
+
+
+
+/*
+ *  Schlüssel k aus dem Baum p entfernen.
+ *  Der Knoten wird nur ausgehängt und in removed zurückgegeben;
+ *  freigeben (oder wiederverwenden) muss ihn der Aufrufer.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Node<Key, Val, Agg, Balancing, Links> :: remove (AVL_Node*& p, Key k, AVL_Node*& removed)
+{
+    AVL_Node*                    q;
+    AVL_Node*                    r;
+    bool                         changed = false;   // Höhenänderung abgefangen
+
+    if (p == nullptr) {
+        throw "Key to delete not in tree!";
+    }
+    else if (k < p->key) {
+        if (remove(p->smaller, k, removed)) {
+            changed = rebalance(p, +1, false);
+        }
+    }
+    else if (k > p->key) {
+        if (remove(p->greater, k, removed)) {
+            changed = rebalance(p, -1, false);
+        }
+    }
+    else if (p->dead) {   // nur noch ein Grabstein, der Schlüssel gilt als gelöscht
+        throw "Key to delete not in tree!";
+    }
+    else if (p->greater == nullptr || p->smaller == nullptr) {
+        if (p->greater == nullptr) {   // Ist p->key bereits das größte Element im Baum?
+            q = p->smaller;   // leerer Baum oder Blatt
+        }
+        else {
+            q = p->greater;   // Blatt
+        }
+        removed = p;   // Element aushängen und
+        p = q;   // durch Blatt (or leeren Baum) ersetzen
+        return true;   // Höhenänderung durch das Löschen
+    }
+    else {
+        q = p->greater;
+        r = p;
+        while (q->smaller != nullptr) {   // kleinstes Element im Unterbaum p->greater finden
+            r = q;   // und auch den Vorgänger darauf merken
+            q = q->smaller;
+        }
+
+        /*
+         *  Da wir nichts über die ererbte Val-Struktur wissen,
+         *  reicht es nicht, einfach die Schlüssel auszutauschen.
+         *  Wir setzen stattdessen alle Zeiger und die Balance um.
+         */
+        if (r != p) {   // Der Vorgänger von q muss hinterher auf p zeigen,
+            r->smaller = p;
+        }
+        else {   // selbst wenn es p selbst ist; nach dem Tausch von p und q wird q dann auf p zeigen.
+            r->greater = p;
+        }
+        swap(p->smaller, q->smaller);
+        swap(p->greater, q->greater);
+        swap(p->balance, q->balance);
+        swap(p, q);   // Bedeutung von p und q umsetzen
+
+        if (remove(p->greater, k, removed)) {   // und das gewünschte Element aus dem Unterbaum löschen
+            changed = rebalance(p, -1, false);   // und Baum rebalancieren
+        }
+    }
+    update(p);   // auch der nach oben getauschte Knoten braucht ein neues Aggregat
+    return changed;
+}
+
+
+
+/*
+ *  Den Knoten mit dem Schlüssel k im Baum p (einen Grabstein) durch den
+ *  ausgehängten Knoten n mit demselben Schlüssel ersetzen; n übernimmt
+ *  Kinder und Balance, der alte Knoten wird freigegeben.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: replace (AVL_Node*& p, Key k, AVL_Node* n)
+{
+    if (p == nullptr) {
+        throw "Key to replace not in tree!";
+    }
+    else if (k < p->key) {
+        replace(p->smaller, k, n);
+    }
+    else if (k > p->key) {
+        replace(p->greater, k, n);
+    }
+    else {
+        n->smaller = p->smaller;
+        n->greater = p->greater;
+        n->balance = p->balance;
+        delete p;
+        p = n;
+    }
+    update(p);
+}
+
+
+
+/*
+ *  Den Knoten mit dem kleinsten Schlüssel aus dem Baum p aushängen (nicht löschen)
+ *  und in min zurückgeben.
+ *  Es wird true zurückgegeben, solange sich die Höhenänderung fortsetzt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Node<Key, Val, Agg, Balancing, Links> :: removeMin (AVL_Node*& p, AVL_Node*& min)
+{
+    bool                    changed = false;
+
+    if (p->smaller == nullptr) {
+        min = p;
+        p = p->greater;   // Blatt oder leerer Baum
+        return true;
+    }
+    if (removeMin(p->smaller, min)) {
+        changed = rebalance(p, +1, false);
+    }
+    update(p);
+    return changed;
+}
+
+
+
+/*
+ *  Verbindet die Bäume l (Höhe hl) und r (Höhe hr) über den Knoten m,
+ *  wobei alle Schlüssel in l kleiner als der von m und alle in r größer sind.
+ *  Es wird am Rand des höheren Baums bis zur Höhe des niedrigeren abgestiegen,
+ *  m dort eingehängt und auf dem Rückweg wie beim Einfügen rebalanciert
+ *  =>  O(|hl - hr| + 1)
+ *  Liefert die neue Wurzel, deren Höhe in h steht.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Node<Key, Val, Agg, Balancing, Links> :: join (AVL_Node* l, int hl, AVL_Node* m, AVL_Node* r, int hr, int& h)
+{
+    int                     hs, hc;   // Höhe des Kinds, in das abgestiegen wird
+    int                     h2;       // und dessen Höhe nach dem Verbinden
+
+    if (hl > hr + 1) {
+        Balancing::childHeights(l, hl, hs, hc);
+        l->greater = join(l->greater, hc, m, r, hr, h2);
+        h = (h2 > hc && rebalance(l, +1, true)) ? hl + 1 : hl;   // h2 ist höchstens um eins gewachsen
+        update(l);
+        return l;
+    }
+    else if (hr > hl + 1) {
+        Balancing::childHeights(r, hr, hc, hs);
+        r->smaller = join(l, hl, m, r->smaller, hc, h2);
+        h = (h2 > hc && rebalance(r, -1, true)) ? hr + 1 : hr;
+        update(r);
+        return r;
+    }
+    else {
+        m->smaller = l;
+        m->greater = r;
+        Balancing::setHeights(m, hl, hr);
+        h = max(hl, hr) + 1;
+        update(m);
+        return m;
+    }
+}
+
+
+
+/*
+ *  Zerlegt den Baum p (Höhe h) in die Bäume l und r (mit den Höhen hl und hr).
+ *  l erhält alle Schlüssel kleiner als k (inclusive: kleiner oder gleich),
+ *  r alle übrigen.
+ *  Auf dem Suchpfad nach k werden die abgetrennten Teile per join wieder
+ *  zusammengesetzt; deren Höhen wachsen nach unten hin, daher insgesamt O(log n).
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: split (AVL_Node* p, int h, Key k, bool inclusive, AVL_Node*& l, int& hl, AVL_Node*& r, int& hr)
+{
+    AVL_Node*               t;
+    int                     ht;
+
+    if (p == nullptr) {
+        l  = r  = nullptr;
+        hl = hr = 0;
+        return;
+    }
+    int hs, hg;
+    Balancing::childHeights(p, h, hs, hg);
+    if (inclusive ? k < p->key : ! (p->key < k)) {   // p gehört nach r
+        split(p->smaller, hs, k, inclusive, l, hl, t, ht);
+        r = join(t, ht, p, p->greater, hg, hr);
+    }
+    else {
+        split(p->greater, hg, k, inclusive, t, ht, r, hr);
+        l = join(p->smaller, hs, p, t, ht, hl);
+    }
+}
+
+
+
+/*
+ *  Alle Knoten des Baums p freigeben
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: destroy (AVL_Node* p)
+{
+    if (p != nullptr) {
+        destroy(p->smaller);
+        destroy(p->greater);
+        delete p;
+    }
+}
+
+
+
+/*
+ *  Knoten des Baums p zählen, dead davon sind Grabsteine
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: census (AVL_Node* p, size_t& nodes, size_t& dead)
+{
+    if (p != nullptr) {
+        census(p->smaller, nodes, dead);
+        census(p->greater, nodes, dead);
+        nodes++;
+        dead += p->dead;
+    }
+}
+
+
+
+/*
+ *  Aus den aufsteigend sortierten Knoten nodes[lo] bis nodes[hi-1]
+ *  einen vollständig ausgeglichenen Baum bauen, dessen Höhe in h zurückgegeben wird.
+ *  Die beiden Hälften sind gleich groß oder um einen Knoten verschieden,
+ *  ihre Höhen unterscheiden sich also um höchstens eins  =>  O(n)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Node<Key, Val, Agg, Balancing, Links> :: build (vector<AVL_Node*>& nodes, size_t lo, size_t hi, int& h)
+{
+    AVL_Node*               p;
+    size_t                  m = lo + (hi - lo) / 2;
+    int                     hs, hg;
+
+    if (lo == hi) {
+        h = 0;
+        return nullptr;
+    }
+    p = nodes[m];
+    p->smaller = build(nodes, lo, m, hs);
+    p->greater = build(nodes, m + 1, hi, hg);
+    Balancing::setHeights(p, hs, hg);
+    h = max(hs, hg) + 1;
+    update(p);
+    return p;
+}
+
+
+
+/*
+ *  Val-Werte eines wiederbelebten Knotens zurücksetzen, als wäre er neu angelegt;
+ *  ohne Zuweisung (etwa beim Block) bleiben sie unverändert.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: resetVal (AVL_Node* p, true_type)
+{
+    static_cast<Val&>(*p) = Val();
+}
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: resetVal (AVL_Node*, false_type)
+{
+}
+
+
+
+/*
+ *  Aggregat des Knotens p aus dem seiner beiden Unterbäume
+ *  und seinem eigenen Wert neu berechnen.
+ *  Die Unterbäume müssen bereits aktuell sein.
+ *  Da update nach jedem Umhängen aufgerufen wird, werden hier
+ *  auch die Eltern-Verweise der Kinder gesetzt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: update (AVL_Node* p)
+{
+    p->updateAggregate(p->key, *p, ! p->dead, p->smaller, p->greater);
+    adopt(p);
+}
+
+
+
+/*
+ *  Eltern-Verweise der beiden Kinder von p auf p setzen
+ *  (ohne ParentLinks bleibt davon nichts übrig)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: adopt (AVL_Node* p)
+{
+    if (p->smaller != nullptr) {
+        p->smaller->setParent(p);
+    }
+    if (p->greater != nullptr) {
+        p->greater->setParent(p);
+    }
+}
+
+
+
+/*
+ *  p ist die (neue) Wurzel und hat keinen Elternknoten
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: makeRoot (AVL_Node* p)
+{
+    if (p != nullptr) {
+        p->setParent(nullptr);
+    }
+}
+
+
+
+/*
+ *  Der Zeiger, über den p erreicht wird: root oder ein Kind-Zeiger des Elternknotens
+ *  (nur mit ParentLinks)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>*& AVL_Node<Key, Val, Agg, Balancing, Links> :: parentLink (AVL_Node*& root, AVL_Node* p)
+{
+    if (p->parent == nullptr) {
+        return root;
+    }
+    return (p->parent->smaller == p) ? p->parent->smaller : p->parent->greater;
+}
+
+
+
+/*
+ *  Den Knoten x aus dem Baum root aushängen (nicht löschen), ohne ihn zu suchen
+ *  (nur mit ParentLinks).
+ *  Hat x zwei Kinder, tauscht er wie bei remove den Platz mit seinem Nachfolger.
+ *  Danach wird von seinem Elternknoten aus nach oben rebalanciert, solange
+ *  sich die Höhe ändert (mit Aggregaten bis zur Wurzel).
+ *  Es wird true zurückgegeben, wenn der ganze Baum niedriger geworden ist.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Node<Key, Val, Agg, Balancing, Links> :: erase (AVL_Node*& root, AVL_Node* x)
+{
+    AVL_Node*               y;
+    AVL_Node*               p;
+    AVL_Node*               q;
+    bool                    fromSmaller;
+    bool                    changed = true;   // Höhenänderung setzt sich fort
+
+    if (x->smaller != nullptr && x->greater != nullptr) {
+        for (y = x->greater; y->smaller != nullptr; y = y->smaller) {
+        }
+        p = x->parent;
+        q = y->parent;
+        parentLink(root, x) = y;
+        if (q == x) {   // y ist das größere Kind von x
+            x->greater = y->greater;
+            y->greater = x;
+            x->setParent(y);
+        }
+        else {
+            q->smaller = x;
+            swap(x->greater, y->greater);
+            x->setParent(q);
+        }
+        swap(x->smaller, y->smaller);
+        swap(x->balance, y->balance);
+        y->setParent(p);
+        adopt(y);
+        adopt(x);
+    }
+
+    p = x->parent;
+    fromSmaller = (p != nullptr && p->smaller == x);
+    parentLink(root, x) = (x->smaller != nullptr) ? x->smaller : x->greater;
+    if (x->smaller != nullptr) {
+        x->smaller->setParent(p);
+    }
+    else if (x->greater != nullptr) {
+        x->greater->setParent(p);
+    }
+
+    while (p != nullptr) {
+        if (! changed && is_same<Agg, NoAgg>::value) {
+            break;   // ohne Aggregate ist weiter oben nichts mehr zu tun
+        }
+        q = p->parent;
+        AVL_Node*& r = parentLink(root, p);
+        if (changed) {
+            changed = rebalance(r, fromSmaller ? +1 : -1, false);
+        }
+        update(r);
+        r->setParent(q);
+        fromSmaller = (q != nullptr && q->smaller == r);
+        p = q;
+    }
+    return changed;
+}
+
+
+
+/*
+ *  Nachfolger bzw. Vorgänger von p in Schlüsselreihenfolge (nur mit ParentLinks):
+ *  im Unterbaum ganz links bzw. rechts oder der erste Vorfahr,
+ *  von dessen anderer Seite man heraufkommt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Node<Key, Val, Agg, Balancing, Links> :: next (AVL_Node* p)
+{
+    if (p->greater != nullptr) {
+        for (p = p->greater; p->smaller != nullptr; p = p->smaller) {
+        }
+        return p;
+    }
+    while (p->parent != nullptr && p->parent->greater == p) {
+        p = p->parent;
+    }
+    return p->parent;
+}
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Node<Key, Val, Agg, Balancing, Links> :: prev (AVL_Node* p)
+{
+    if (p->smaller != nullptr) {
+        for (p = p->smaller; p->greater != nullptr; p = p->greater) {
+        }
+        return p;
+    }
+    while (p->parent != nullptr && p->parent->smaller == p) {
+        p = p->parent;
+    }
+    return p->parent;
+}
+
+
+
+/*
+ *  Nachdem die Val-Werte im Knoten mit dem Schlüssel k von außen verändert wurden,
+ *  werden die Aggregate auf dem Pfad von p bis zu diesem Knoten neu berechnet.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: refresh (AVL_Node* p, Key k)
+{
+    if (p == nullptr) {
+        throw "Key to refresh not in tree!";
+    }
+    else if (k < p->key) {
+        refresh(p->smaller, k);
+    }
+    else if (k > p->key) {
+        refresh(p->greater, k);
+    }
+    update(p);
+}
+
+
+
+/*
+ *  Aggregat über alle Schlüssel zwischen lo und hi (jeweils einschließlich).
+ *  lower bzw. upper gibt an, ob die Grenze für den Unterbaum p überhaupt noch gilt;
+ *  ein Unterbaum ohne Grenzen liefert direkt sein gespeichertes Aggregat.
+ *  Nachdem sich die Pfade zu lo und hi getrennt haben, hat jeder Aufruf
+ *  nur noch eine Grenze und steigt nur noch auf einer Seite ab  =>  O(log n)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+typename Agg::Type AVL_Node<Key, Val, Agg, Balancing, Links> :: reduce (AVL_Node* p, Key lo, Key hi, bool lower, bool upper)
+{
+    if (p == nullptr) {
+        return Agg::identity();
+    }
+    else if (! lower && ! upper) {
+        return p->aggregate;
+    }
+    else if (lower && p->key < lo) {
+        return reduce(p->greater, lo, hi, lower, upper);
+    }
+    else if (upper && p->key > hi) {
+        return reduce(p->smaller, lo, hi, lower, upper);
+    }
+    else {
+        return Agg::combine(Agg::combine(reduce(p->smaller, lo, hi, lower, false),
+                                         p->dead ? Agg::identity() : Agg::lift(p->key, *p)),
+                            reduce(p->greater, lo, hi, false, upper));
+    }
+}
+
+
+
+/*
+ *  Alle Knoten des Baums p in aufsteigender Reihenfolge an f übergeben
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename Function>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: forEach (AVL_Node* p, Function& f)
+{
+    if (p != nullptr) {
+        forEach(p->smaller, f);
+        f(p);
+        forEach(p->greater, f);
+    }
+}
+
+
+
+/*
+ *  Den Baum p in der Tiefe depth in Unterbäume zerlegen.
+ *  parts enthält anschließend in aufsteigender Reihenfolge
+ *  die (nicht leeren) Unterbäume (true) und die Knoten oberhalb davon (false).
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: partition (AVL_Node* p, int depth, vector<pair<AVL_Node*, bool>>& parts)
+{
+    if (p == nullptr) {
+        return;
+    }
+    else if (depth == 0) {
+        parts.push_back(make_pair(p, true));
+    }
+    else {
+        partition(p->smaller, depth - 1, parts);
+        parts.push_back(make_pair(p, false));
+        partition(p->greater, depth - 1, parts);
+    }
+}
+
+
+
+/*
+ *  Höhe des Baum p tatsächlich berechnen;
+ *  bricht mit Fehlermeldung ab,
+ *  wenn AVL-Kriterium verletzt ist
+ *  oder Balance und Höhe der Unterbäume nicht zueinander passen
+ *  (bei WAVL entsprechend für die Ränge, „Höhe“ ist dann Rang + 1).
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+int AVL_Node<Key, Val, Agg, Balancing, Links> :: calcHeight (AVL_Node* p)
+{
+    if (p == nullptr) {
+        return 0;
+    }
+    else {
+        int h1 = calcHeight(p->smaller);
+        int h2 = calcHeight(p->greater);
+        checkParent(p);
+        return Balancing::checkHeight(p, h1, h2);
+    }
+}
+
+
+
+/*
+ *  Wie oben, aber nur bis zur Tiefe depth;
+ *  darunter werden die vorab (parallel) berechneten Höhen heights
+ *  der Zerlegung aus partition der Reihe nach verwendet.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+int AVL_Node<Key, Val, Agg, Balancing, Links> :: calcHeight (AVL_Node* p, int depth, vector<int>& heights, size_t& next)
+{
+    if (p == nullptr) {
+        return 0;
+    }
+    else if (depth == 0) {
+        return heights[next++];
+    }
+    else {
+        int h1 = calcHeight(p->smaller, depth - 1, heights, next);
+        next++;   // der Knoten p selbst
+        int h2 = calcHeight(p->greater, depth - 1, heights, next);
+        checkParent(p);
+        return Balancing::checkHeight(p, h1, h2);
+    }
+}
+
+
+
+/*
+ *  Zeigen die Kinder von p auf p zurück? (ohne ParentLinks immer)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: checkParent (AVL_Node* p)
+{
+    if ((p->smaller != nullptr && ! p->smaller->isChildOf(p))
+        || (p->greater != nullptr && ! p->greater->isChildOf(p))) {
+        throw "Parent link not in line!";
+    }
+}
+
+
+
+/*
+ *  Liegt der Schlüssel von p zwischen den Schranken lo und hi?
+ *  nullptr bedeutet unbeschränkt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Node<Key, Val, Agg, Balancing, Links> :: inRange (AVL_Node* p, Key* lo, Key* hi)
+{
+    return (lo == nullptr || *lo < p->key) && (hi == nullptr || p->key < *hi);
+}
+
+
+
+/*
+ *  Prüft nur den Knoten p (nicht seine Unterbäume) in O(log n):
+ *  Schlüssel zwischen den Schranken der Vorfahren und den direkten Kindern,
+ *  Balance gegenüber den Höhen, die Balancing::height aus den Unterbäumen abliest.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: checkLocal (AVL_Node* p, Key* lo, Key* hi)
+{
+    if (! inRange(p, lo, hi)
+        || (p->smaller != nullptr && ! (p->smaller->key < p->key))
+        || (p->greater != nullptr && ! (p->key < p->greater->key))) {
+        throw "Keys not in order!";
+    }
+    checkParent(p);
+    Balancing::checkHeight(p, Balancing::height(p->smaller), Balancing::height(p->greater));
+}
+
+
+
+/*
+ *  Knoten p und seine beiden Kinder lokal prüfen;
+ *  rotierte Knoten hängen immer direkt am Suchpfad.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: checkAround (AVL_Node* p, Key* lo, Key* hi)
+{
+    checkLocal(p, lo, hi);
+    if (p->smaller != nullptr) {
+        checkLocal(p->smaller, lo, &p->key);
+    }
+    if (p->greater != nullptr) {
+        checkLocal(p->greater, &p->key, hi);
+    }
+}
+
+
+
+/*
+ *  Prüft alle Knoten, die ein insert oder remove von k verändert haben kann:
+ *  den Suchpfad nach k und – weil remove den Nachfolger nach oben tauscht
+ *  und dann dort rebalanciert – den Pfad zum Nachfolger des
+ *  kleinsten größeren Knotens auf diesem Pfad; jeweils mit den Kindern.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: checkPath (AVL_Node* p, Key k)
+{
+    AVL_Node*               ceil = nullptr;
+    Key*                    lo = nullptr;
+    Key*                    hi = nullptr;
+    Key*                    ceilHi = nullptr;
+
+    while (p != nullptr) {
+        checkAround(p, lo, hi);
+        if (k > p->key) {
+            lo = &p->key;
+            p = p->greater;
+        }
+        else {
+            ceil = p;
+            ceilHi = hi;
+            if (! (k < p->key)) {
+                break;   // gefunden
+            }
+            hi = &p->key;
+            p = p->smaller;
+        }
+    }
+    if (ceil != nullptr) {
+        lo = &ceil->key;
+        hi = ceilHi;
+        for (p = ceil->greater; p != nullptr; p = p->smaller) {
+            checkAround(p, lo, hi);
+            hi = &p->key;
+        }
+    }
+}
+
+
+
+/*
+ *  Sucht den auf k folgenden Knoten (bei first den kleinsten)
+ *  und prüft ihn lokal; die Knoten auf dem Weg dorthin
+ *  werden gegen die Schranken ihrer Vorfahren geprüft.
+ *  Liefert nullptr, wenn es keinen größeren Schlüssel gibt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Node<Key, Val, Agg, Balancing, Links> :: checkNext (AVL_Node* p, Key k, bool first)
+{
+    AVL_Node*               next = nullptr;
+    Key*                    lo = nullptr;
+    Key*                    hi = nullptr;
+    Key*                    nextLo = nullptr;
+    Key*                    nextHi = nullptr;
+
+    while (p != nullptr) {
+        if (! inRange(p, lo, hi)) {
+            throw "Keys not in order!";
+        }
+        if (first || k < p->key) {
+            next = p;
+            nextLo = lo;
+            nextHi = hi;
+            hi = &p->key;
+            p = p->smaller;
+        }
+        else {
+            lo = &p->key;
+            p = p->greater;
+        }
+    }
+    if (next != nullptr) {
+        checkLocal(next, nextLo, nextHi);
+    }
+    return next;
+}
+
+
+
+/*
+ *  Gibt einfach n-mal acht Leerzeichen aus.
+ *  Wer sich bei dem Namen der Methode an sense8 erinnert fühlt,
+ *  könnte damit richtigliegen …
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: space8 (unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        cout << "        ";
+    }
+}
+
+
+
+/*
+ *  Zaubert eine Darstellung des Baums auf den Bildschirm.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Node<Key, Val, Agg, Balancing, Links> :: display (AVL_Node* p, int h, char c)
+{
+    if (p != nullptr) {
+        display(p->smaller, h-1, 'L');
+        space8(h);
+        cout << c << h << ": " << p->key << " (" << p->balance << ")" << (p->dead ? " †" : "");
+        p->displayVal();
+        cout << endl;
+        display(p->greater, h-1, 'R');
+    }
+    else {
+        space8(h);
+        cout << c << h << ": " << "÷" << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die nicht statischen Knoten-Methoden
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktor – Val muss einen Standard-Konstruktor anbieten
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links> :: AVL_Node (Key k) : Val ()
+{
+    smaller = nullptr;
+    greater = nullptr;
+    balance = 0;
+    dead    = false;
+    key     = k;
+}
+
+
+
+/*
+ *  Wer extern den Schlüssel aus dem Knoten extrahieren will …
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+Key AVL_Node<Key, Val, Agg, Balancing, Links> :: getKey ()
+{
+    return key;
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die Methoden des Fingers
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktor – ein neuer Finger zeigt nirgendwohin, die erste Suche beginnt an der Wurzel.
+ *  Ein Finger gehört immer zu genau einem Baum.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Finger<Key, Val, Agg, Balancing, Links> :: AVL_Finger ()
+{
+    version = 0;
+    tree    = nullptr;
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die Methoden des Knoten-Handles
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktoren – leer, für einen ausgehängten Knoten (nur der Baum) und zum Verschieben
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: AVL_NodeHandle ()
+{
+    node = nullptr;
+}
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: AVL_NodeHandle (Node* p)
+{
+    node = p;
+}
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: AVL_NodeHandle (AVL_NodeHandle&& h)
+{
+    node   = h.node;
+    h.node = nullptr;
+}
+
+
+
+/*
+ *  Destruktor – ein nicht wieder eingehängter Knoten wird freigegeben
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: ~AVL_NodeHandle ()
+{
+    delete node;
+}
+
+
+
+/*
+ *  Verschieben; ein bisher gehaltener Knoten wird freigegeben
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_NodeHandle<Key, Val, Agg, Balancing, Links>& AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: operator= (AVL_NodeHandle&& h)
+{
+    if (this != &h) {
+        delete node;
+        node   = h.node;
+        h.node = nullptr;
+    }
+    return *this;
+}
+
+
+
+/*
+ *  Hält das Handle keinen Knoten (mehr)?
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: empty ()
+{
+    return node == nullptr;
+}
+
+
+
+/*
+ *  Der Knoten selbst, etwa um an die Val-Werte zu kommen
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: get ()
+{
+    return node;
+}
+
+
+
+/*
+ *  Schlüssel des Knotens abfragen bzw. vor dem Wiedereinhängen ändern
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+Key AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: getKey ()
+{
+    if (node == nullptr) {
+        throw "Empty node handle!";
+    }
+    return node->key;
+}
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_NodeHandle<Key, Val, Agg, Balancing, Links> :: setKey (Key k)
+{
+    if (node == nullptr) {
+        throw "Empty node handle!";
+    }
+    node->key = k;
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Die Baum-Methoden
+ *
+ *  rufen im Wesentlichen die entsprechenden Methoden
+ *  aus der Knotenklasse mit der Wurzel als Parameter auf.
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktor
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Tree<Key, Val, Agg, Balancing, Links> :: AVL_Tree ()
+{
+    root   = nullptr;
+    height = 0;
+    nodes      = 0;
+    tombstones = 0;
+    purgeRatio = 0;
+    version    = 0;
+    recorder   = nullptr;
+    cursorValid = false;
+}
+
+
+
+/*
+ *  Geänderten Schlüssel für checkStep vormerken;
+ *  ist die Liste voll, bleibt es bei der normalen Runde durch den Baum.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: touch (Key k)
+{
+    if (touched.size() < maxTouched) {
+        touched.push_back(k);
+    }
+}
+
+
+
+/*
+ *  Tiefe, in der der Baum für die parallelen Durchläufe zerlegt wird:
+ *  etwa acht Unterbäume je Thread, damit sich die Last durch Stehlen ausgleicht.
+ *  0 bedeutet, dass sich das Aufteilen bei dieser Baumhöhe nicht lohnt.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+int AVL_Tree<Key, Val, Agg, Balancing, Links> :: splitDepth (unsigned threads)
+{
+    int                     depth = 0;
+
+    while ((1u << depth) < 8 * threads) {
+        depth++;
+    }
+    return (height > depth + 10) ? depth : 0;
+}
+
+
+
+/*
+ *  Pool und Zerlegungstiefe für einen parallelen Durchlauf.
+ *  pool nullptr steht für den gemeinsamen Pool; der wird erst angelegt,
+ *  wenn der Baum hoch genug ist, dass sich das Aufteilen lohnt.
+ *  Liefert nullptr (und depth 0), wenn seriell gerechnet wird.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_ThreadPool* AVL_Tree<Key, Val, Agg, Balancing, Links> :: splitPool (AVL_ThreadPool* pool, int& depth)
+{
+    depth = splitDepth(pool != nullptr ? pool->size() : AVL_ThreadPool::sharedSize());
+    if (depth == 0) {
+        return nullptr;
+    }
+    return (pool != nullptr) ? pool : &AVL_ThreadPool::shared();
+}
+
+
+
+/*
+ *  Knoten p als gelöscht markieren (dead) oder wiederbeleben – ohne Umbau;
+ *  nur die Aggregate auf dem Pfad zu p müssen nachgeführt werden.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: mark (Node* p, bool dead)
+{
+    if (dead) {
+        tombstones++;
+    }
+    else {
+        Node::resetVal(p, is_copy_assignable<Val>());
+        tombstones--;
+    }
+    p->dead = dead;
+    if (! is_same<Agg, NoAgg>::value) {
+        Node::refresh(root, p->key);
+    }
+}
+
+
+
+/*
+ *  Die Zählungen der im Hintergrund freigegebenen Bereiche übernehmen:
+ *  wait wartet auf alle, sonst nur die schon fertigen.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: settle (bool wait)
+{
+    size_t                  i = 0;
+
+    while (i < censuses.size()) {
+        if (wait || censuses[i].wait_for(chrono::seconds(0)) == future_status::ready) {
+            pair<size_t, size_t> c = censuses[i].get();
+            nodes      -= c.first;
+            tombstones -= c.second;
+            censuses.erase(censuses.begin() + i);
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+
+
+/*
+ *  Vom Finger f aus nach k suchen: erst so weit aufsteigen, bis k zwischen
+ *  die Schranken des Unterbaums fällt, dann wie gewohnt absteigen.
+ *  Liefert den Knoten mit k (auch einen Grabstein) oder nullptr;
+ *  der Finger zeigt anschließend auf diesen bzw. auf den letzten besuchten Knoten,
+ *  unter dem k einzufügen wäre.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: descend (Finger& f, Key k)
+{
+    Node*                   p;
+    int                     i;
+
+    if (f.tree != this || f.version != version) {   // anderer Baum oder inzwischen umgebaut
+        f.path.clear();
+        f.tree    = this;
+        f.version = version;
+    }
+    while (f.path.size() > 1) {
+        typename Finger::Step& s = f.path.back();
+        if ((s.lower < 0 || f.path[s.lower].node->key < k) && (s.upper < 0 || k < f.path[s.upper].node->key)) {
+            break;
+        }
+        f.path.pop_back();
+    }
+    if (f.path.empty()) {
+        if (root == nullptr) {
+            return nullptr;
+        }
+        f.path.push_back({root, -1, -1});
+    }
+    while (true) {
+        i = f.path.size() - 1;
+        p = f.path[i].node;
+        if (k < p->key) {
+            if (p->smaller == nullptr) {
+                return nullptr;
+            }
+            f.path.push_back({p->smaller, f.path[i].lower, i});
+        }
+        else if (k > p->key) {
+            if (p->greater == nullptr) {
+                return nullptr;
+            }
+            f.path.push_back({p->greater, i, f.path[i].upper});
+        }
+        else {
+            return p;
+        }
+    }
+}
+
+
+
+/*
+ *  Der Zeiger, über den der Knoten auf Stufe i des Fingers erreicht wird
+ *  (die Wurzel oder ein Kind-Zeiger der Stufe darüber)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>*& AVL_Tree<Key, Val, Agg, Balancing, Links> :: link (Finger& f, size_t i)
+{
+    Node*                   p;
+
+    if (i == 0) {
+        return root;
+    }
+    p = f.path[i - 1].node;
+    return (p->smaller == f.path[i].node) ? p->smaller : p->greater;
+}
+
+
+
+/*
+ *  Wer die Höhe wissen will …
+ *  (bei WAVL der Rang der Wurzel + 1, eine obere Schranke der Höhe)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+int AVL_Tree<Key, Val, Agg, Balancing, Links> :: getHeight ()
+{
+    return height;
+}
+
+
+
+/*
+ *  Anzahl der Schlüssel (ohne Grabsteine)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+size_t AVL_Tree<Key, Val, Agg, Balancing, Links> :: size ()
+{
+    settle(true);
+    return nodes - tombstones;
+}
+
+
+
+/*
+ *  Schlüssel k in dem Baum suchen
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: find (Key k)
+{
+    Node*                   p;
+
+    p = Node::find(root, k);
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Find, k);
+    }
+    return (p == nullptr || p->dead) ? nullptr : p;
+}
+
+
+
+/*
+ *  Schlüssel k in den Baum einfügen
+ *  Schlüssel darf nicht schon im Baum enthalten sein
+ *  (ein Grabstein mit dem Schlüssel wird an Ort und Stelle wiederbelebt)
+ *  Liefert einen Zeiger auf den neuen Knoten
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: insert (Key k)
+{
+    Node*                   inserted = insertKey(k);
+
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Insert, k);
+    }
+    return inserted;
+}
+
+
+
+/*
+ *  insert ohne Aufzeichnung, auch für safeInsert
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: insertKey (Key k)
+{
+    Node*                   inserted = nullptr;
+
+    if (tombstones > 0 && (inserted = Node::find(root, k)) != nullptr && inserted->dead) {
+        mark(inserted, false);
+        return inserted;
+    }
+    if (Node::insert(root, k, inserted)) {
+        height++;
+    }
+    Node::makeRoot(root);
+    nodes++;
+    version++;
+    touch(k);
+    return inserted;
+}
+
+
+
+/*
+ *  Schlüssel k aus dem Baum löschen
+ *  Schlüssel muss ich im Baum befinden
+ *  Nach setLazyRemove wird der Knoten nur als gelöscht markiert (O(log n), ohne Rotation),
+ *  aufgeräumt wird erst, wenn zu viele Grabsteine im Baum stehen.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: remove (Key k)
+{
+    removeKey(k);
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Remove, k);
+    }
+}
+
+
+
+/*
+ *  remove ohne Aufzeichnung, auch für safeRemove
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: removeKey (Key k)
+{
+    Node*                   p;
+    Node*                   removed;
+
+    if (purgeRatio > 0) {
+        if ((p = Node::find(root, k)) == nullptr || p->dead) {
+            throw "Key to delete not in tree!";
+        }
+        mark(p, true);
+        settle(false);   // zu viele Grabsteine zu zählen ist hier unschädlich
+        if (tombstones > purgeRatio * nodes) {
+            purge();
+        }
+        return;
+    }
+    if (Node::remove(root, k, removed)) {
+        height--;
+    }
+    delete removed;
+    Node::makeRoot(root);
+    nodes--;
+    version++;
+    touch(k);
+}
+
+
+
+/*
+ *  Es wird geprüft, ob sich der Schlüssel k bereits im Baum befindet,
+ *  und nur, wenn nicht, insert aufgerufen.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: safeInsert (Key k)
+{
+    Node*                   foundOrIserted;
+
+    if ((foundOrIserted = Node::find(root, k)) == nullptr) {
+        foundOrIserted = insertKey(k);
+    }
+    else if (foundOrIserted->dead) {
+        mark(foundOrIserted, false);
+    }
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::SafeInsert, k);
+    }
+    return foundOrIserted;
+}
+
+
+
+/*
+ *  Es wird geprüft, ob sich der Schlüssel k im Baum befindet,
+ *  und nur dann remove aufgerufen.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: safeRemove (Key k)
+{
+    Node*                   p;
+
+    if ((p = Node::find(root, k)) != nullptr && ! p->dead) {
+        removeKey(k);
+    }
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::SafeRemove, k);
+    }
+}
+
+
+
+/*
+ *  Schlüssel k ausgehend vom Finger suchen (Finger-Suche);
+ *  liegt k nahe beim zuletzt besuchten Schlüssel, sind es nur wenige Schritte.
+ *  Der Finger zeigt anschließend auf den gefundenen Knoten bzw. die Einfügestelle.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: find_near (Finger& finger, Key k)
+{
+    Node*                   p;
+
+    p = descend(finger, k);
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Find, k);
+    }
+    return (p == nullptr || p->dead) ? nullptr : p;
+}
+
+
+
+/*
+ *  Schlüssel k ausgehend vom Finger hint einfügen (Schlüssel darf nicht im Baum sein).
+ *  Abgestiegen wird wie bei find_near, rebalanciert dann entlang des gemerkten Pfads
+ *  nur so weit, wie sich die Höhe ändert (mit Aggregaten bis zur Wurzel).
+ *  Der Finger zeigt anschließend auf den neuen Knoten; hängt man fortlaufend
+ *  hinten an, bleibt er also am rechten Rand und das Einfügen kostet amortisiert O(1).
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: insert (Finger& hint, Key k)
+{
+    Node*                   p;
+    Node*                   inserted;
+    size_t                  i;
+    int                     rotated = -1;     // Stufe, an der rotiert wurde
+    bool                    changed = true;   // Höhenänderung setzt sich fort
+
+    if ((p = descend(hint, k)) != nullptr) {
+        if (! p->dead) {
+            throw "Key to insert already in tree!";
+        }
+        mark(p, false);
+        if (recorder != nullptr) {
+            recorder->log(AVL_Recorder<Key>::Insert, k);
+        }
+        return p;
+    }
+    inserted = new Node(k);
+    if (inserted == nullptr) {
+        throw "Out of memory!";
+    }
+    Node::update(inserted);
+    if (hint.path.empty()) {
+        root = inserted;
+        hint.path.push_back({inserted, -1, -1});
+    }
+    else {
+        i = hint.path.size() - 1;
+        p = hint.path[i].node;
+        if (k < p->key) {
+            p->smaller = inserted;
+            hint.path.push_back({inserted, hint.path[i].lower, int(i)});
+        }
+        else {
+            p->greater = inserted;
+            hint.path.push_back({inserted, int(i), hint.path[i].upper});
+        }
+    }
+
+    for (i = hint.path.size() - 1; i-- > 0; ) {
+        if (! changed && is_same<Agg, NoAgg>::value) {
+            Node::update(link(hint, i));   // setzt nach einer Rotation darunter den Eltern-Verweis
+            break;                         // ohne Aggregate ist weiter oben nichts mehr zu tun
+        }
+        Node*& q = link(hint, i);
+        p = q;
+        if (changed) {
+            changed = Node::rebalance(q, k < p->key ? -1 : +1, true);
+            if (q != p) {
+                rotated = i;
+            }
+        }
+        Node::update(q);
+    }
+    if (changed) {
+        height++;
+    }
+    Node::makeRoot(root);
+    nodes++;
+    touch(k);
+    version++;
+    hint.version = version;
+    if (rotated >= 0) {   // unterhalb der Rotation stimmt der Pfad nicht mehr
+        hint.path.resize(rotated);
+        descend(hint, k);
+    }
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Insert, k);
+    }
+    return inserted;
+}
+
+
+
+/*
+ *  Schlüssel k ausgehend vom Finger hint löschen (Schlüssel muss im Baum sein).
+ *  Abgestiegen wird wie bei find_near; hat der Knoten zwei Kinder, verlängert
+ *  der Finger den Pfad bis zum Nachfolger und tauscht ihn (wie remove) nach oben.
+ *  Rebalanciert wird dann entlang des gemerkten Pfads nur so weit, wie sich
+ *  die Höhe ändert (mit Aggregaten bis zur Wurzel).
+ *  Der Finger zeigt anschließend auf die Stelle, an der k stand; nach setLazyRemove
+ *  wird der Knoten nur markiert und der Finger bleibt, wie er ist.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: remove (Finger& hint, Key k)
+{
+    Node*                   p;
+    Node*                   q;
+    size_t                  i;
+    size_t                  m;                // Stufe von k
+    size_t                  lowest;           // oberste Stufe, die sich geändert hat
+    int                     offset;           // -1: greater geschrumpft, +1: smaller
+    bool                    changed = true;   // Höhenänderung setzt sich fort
+
+    if ((p = descend(hint, k)) == nullptr || p->dead) {
+        throw "Key to delete not in tree!";
+    }
+    if (purgeRatio > 0) {
+        mark(p, true);
+        settle(false);   // zu viele Grabsteine zu zählen ist hier unschädlich
+        if (tombstones > purgeRatio * nodes) {
+            purge();
+        }
+        if (recorder != nullptr) {
+            recorder->log(AVL_Recorder<Key>::Remove, k);
+        }
+        return;
+    }
+
+    m = hint.path.size() - 1;
+    if (p->smaller != nullptr && p->greater != nullptr) {
+        hint.path.push_back({p->greater, int(m), hint.path[m].upper});
+        while ((q = hint.path.back().node)->smaller != nullptr) {
+            i = hint.path.size() - 1;
+            hint.path.push_back({q->smaller, hint.path[i].lower, int(i)});
+        }
+        Node*& top = link(hint, m);   // vor dem Umsetzen holen, solange der Pfad noch stimmt
+        i = hint.path.size() - 1;     // q ist der Nachfolger, ganz unten im Pfad
+        if (i - 1 != m) {
+            hint.path[i - 1].node->smaller = p;
+        }
+        else {   // q ist direkt p->greater und zeigt nach dem Tausch auf p
+            p->greater = p;
+        }
+        swap(p->smaller, q->smaller);
+        swap(p->greater, q->greater);
+        swap(p->balance, q->balance);
+        top = q;
+        hint.path[m].node = q;
+        hint.path[i].node = p;
+    }
+
+    i = hint.path.size() - 1;   // p hat jetzt höchstens ein Kind
+    Node*& slot = link(hint, i);
+    offset = (i > 0 && &slot == &hint.path[i - 1].node->smaller) ? +1 : -1;
+    slot = (p->smaller != nullptr) ? p->smaller : p->greater;
+    lowest = i;
+    while (i-- > 0) {
+        Node*& r = link(hint, i);
+        if (! changed && i < m && is_same<Agg, NoAgg>::value) {   // erst oberhalb des getauschten Knotens
+            Node::update(r);   // setzt nach einer Rotation (oder dem Tausch) darunter den Eltern-Verweis
+            break;             // ohne Aggregate ist weiter oben nichts mehr zu tun
+        }
+        int up = (i > 0 && &r == &hint.path[i - 1].node->smaller) ? +1 : -1;
+        if (changed) {
+            q = r;
+            changed = Node::rebalance(r, offset, false);
+            if (r != q) {
+                lowest = i;
+            }
+        }
+        Node::update(r);
+        offset = up;
+    }
+    if (changed) {
+        height--;
+    }
+    delete p;
+    Node::makeRoot(root);
+    nodes--;
+    touch(k);
+    version++;
+    hint.version = version;
+    hint.path.resize(min(lowest, m));   // ab dort stimmt der Pfad nicht mehr
+    descend(hint, k);
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Remove, k);
+    }
+}
+
+
+
+/*
+ *  Den Knoten p löschen, den man schon (etwa von find) in der Hand hat:
+ *  ohne erneute Suche, rebalanciert wird von p aus nach oben.
+ *  Braucht ParentLinks; bei verzögertem Löschen wird p nur markiert.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: erase (Node* p)
+{
+    static_assert(is_same<Links, ParentLinks>::value, "erase(Node*) needs ParentLinks!");
+
+    Key                     k;
+
+    if (p->dead) {
+        throw "Key to delete not in tree!";
+    }
+    k = p->key;
+    if (purgeRatio > 0) {
+        mark(p, true);
+        settle(false);   // zu viele Grabsteine zu zählen ist hier unschädlich
+        if (tombstones > purgeRatio * nodes) {
+            purge();
+        }
+    }
+    else {
+        touch(k);
+        if (Node::erase(root, p)) {
+            height--;
+        }
+        delete p;
+        Node::makeRoot(root);
+        nodes--;
+        version++;
+    }
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Remove, k);
+    }
+}
+
+
+
+/*
+ *  Den Knoten mit dem Schlüssel k aushängen, ohne ihn freizugeben;
+ *  das zurückgegebene Handle besitzt ihn (auch bei verzögertem Löschen).
+ *  Schlüssel muss sich im Baum befinden
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_NodeHandle<Key, Val, Agg, Balancing, Links> AVL_Tree<Key, Val, Agg, Balancing, Links> :: extract (Key k)
+{
+    Node*                   removed;
+
+    if (Node::remove(root, k, removed)) {
+        height--;
+    }
+    Node::makeRoot(root);
+    nodes--;
+    version++;
+    touch(k);
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Remove, k);
+    }
+
+    removed->smaller = nullptr;
+    removed->greater = nullptr;
+    removed->balance = 0;
+    removed->setParent(nullptr);
+    return Handle(removed);
+}
+
+
+
+/*
+ *  Den Knoten aus dem Handle h unter seinem (eventuell geänderten) Schlüssel einhängen;
+ *  h ist danach leer. Schlüssel darf nicht im Baum sein, sonst behält h den Knoten.
+ *  Ein Grabstein mit dem Schlüssel wird durch den Knoten ersetzt.
+ *  Liefert einen Zeiger auf den Knoten
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: insert (Handle&& h)
+{
+    Node*                   inserted = h.node;
+    Node*                   p;
+
+    if (inserted == nullptr) {
+        throw "Empty node handle!";
+    }
+    if (tombstones > 0 && (p = Node::find(root, inserted->key)) != nullptr && p->dead) {
+        Node::replace(root, inserted->key, inserted);
+        tombstones--;
+    }
+    else {
+        if (Node::insert(root, inserted->key, inserted)) {
+            height++;
+        }
+        nodes++;
+    }
+    h.node = nullptr;
+    Node::makeRoot(root);
+    version++;
+    touch(inserted->key);
+    if (recorder != nullptr) {
+        recorder->log(AVL_Recorder<Key>::Insert, inserted->key);
+    }
+    return inserted;
+}
+
+
+
+/*
+ *  Nächster bzw. vorheriger Knoten (ohne Grabsteine) in Schlüsselreihenfolge,
+ *  nullptr am Ende; ohne Suche von der Wurzel, braucht ParentLinks.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: next (Node* p)
+{
+    static_assert(is_same<Links, ParentLinks>::value, "next(Node*) needs ParentLinks!");
+
+    do {
+        p = Node::next(p);
+    } while (p != nullptr && p->dead);
+    return p;
+}
+
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Node<Key, Val, Agg, Balancing, Links>* AVL_Tree<Key, Val, Agg, Balancing, Links> :: prev (Node* p)
+{
+    static_assert(is_same<Links, ParentLinks>::value, "prev(Node*) needs ParentLinks!");
+
+    do {
+        p = Node::prev(p);
+    } while (p != nullptr && p->dead);
+    return p;
+}
+
+
+
+/*
+ *  Alle Schlüssel von lo bis hi (einschließlich) aus dem Baum löschen.
+ *  Der Bereich wird mit zwei split herausgetrennt und der Rest mit einem join
+ *  wieder verbunden; rebalanciert wird nur entlang der Pfade zu lo und hi
+ *  =>  O(log n) für die Struktur und O(k) für das Zählen und Freigeben der k Knoten,
+ *  das auf Wunsch (background) AVL_Reclaimer::shared() im Hintergrund erledigt
+ *  (AVL_Reclaimer::shared().wait() wartet darauf); die Zählung übernimmt
+ *  der Baum mit settle, spätestens bei size() oder purge().
+ *  Ist hi < lo, ist der Bereich leer und es bleibt alles, wie es ist.
+ *  Bei laufender Aufzeichnung (setRecorder) nicht erlaubt, die Spur hat dafür keine Operation.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: erase_range (Key lo, Key hi, bool background)
+{
+    Node*                   less;
+    Node*                   rest;
+    Node*                   range;
+    Node*                   greater;
+    Node*                   min;
+    int                     hLess, hRest, hRange, hGreater;
+    size_t                  n = 0, dead = 0;
+    AVL_Reclaimer*          reclaimer = nullptr;
+
+    if (recorder != nullptr) {
+        throw "erase_range can’t be recorded!";
+    }
+    if (hi < lo) {   // leerer Bereich, ohne split und join
+        return;
+    }
+    if (background) {
+        reclaimer = &AVL_Reclaimer::shared();   // startet den Thread, solange der Baum noch unverändert ist
+    }
+    Node::split(root, height, lo, false, less, hLess, rest, hRest);
+    Node::split(rest, hRest, hi, true, range, hRange, greater, hGreater);
+    if (greater == nullptr) {
+        root   = less;
+        height = hLess;
+    }
+    else {
+        if (Node::removeMin(greater, min)) {
+            hGreater--;
+        }
+        root = Node::join(less, hLess, min, greater, hGreater, height);
+    }
+    Node::makeRoot(root);
+    touch(lo);   // nur entlang dieser beiden Pfade wurde umgebaut
+    touch(hi);
+    version++;
+
+    if (reclaimer != nullptr && range != nullptr) {
+        try {
+            auto job = make_shared<packaged_task<pair<size_t, size_t> ()>>([range] {
+                size_t n = 0, dead = 0;
+                Node::census(range, n, dead);
+                Node::destroy(range);
+                return make_pair(n, dead);
+            });
+            future<pair<size_t, size_t>> counted = job->get_future();
+            censuses.reserve(censuses.size() + 1);   // damit nach dem post nichts mehr werfen kann
+            reclaimer->post([job] { (*job)(); });
+            censuses.push_back(move(counted));
+            return;
+        } catch (...) {
+            // kein Platz in der Warteschlange: dann eben gleich hier zählen und freigeben
+        }
+    }
+    Node::census(range, n, dead);
+    nodes      -= n;
+    tombstones -= dead;
+    Node::destroy(range);
+}
+
+
+
+/*
+ *  Verzögertes Löschen einschalten: remove markiert die Knoten nur noch (Grabsteine),
+ *  was bei vielen Löschungen auf einmal die Ausreißer durch Rotationen und delete vermeidet.
+ *  Sobald mehr als der Anteil ratio der Knoten Grabsteine sind, räumt purge auf.
+ *  ratio 0 schaltet zurück auf sofortiges Löschen (vorhandene Grabsteine bleiben bis zum nächsten purge).
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: setLazyRemove (double ratio)
+{
+    purgeRatio = ratio;
+}
+
+
+
+/*
+ *  Ab jetzt alle insert, remove, find, safeInsert und safeRemove in r aufzeichnen
+ *  (auch die über einen Finger, über Handles und erase), jeweils erst, wenn sie
+ *  gelungen sind – eine geworfene Operation fehlt also; erase_range wirft dann,
+ *  nullptr beendet die Aufzeichnung (r gehört weiterhin dem Aufrufer).
+ *  Nicht für nebenläufige Zugriffe gedacht, auch nicht für nebenläufiges find.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: setRecorder (AVL_Recorder<Key>* r)
+{
+    recorder = r;
+}
+
+
+
+/*
+ *  Alle Grabsteine freigeben und aus den übrigen Knoten in einem Durchgang
+ *  einen vollständig ausgeglichenen Baum bauen  =>  O(n)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: purge ()
+{
+    vector<Node*>           live;
+    vector<Node*>           dead;
+    auto                    collect = [&live, &dead] (Node* p) { (p->dead ? dead : live).push_back(p); };
+
+    settle(true);   // danach werden die Zähler neu gesetzt
+    live.reserve(nodes - tombstones);
+    Node::forEach(root, collect);
+    for (auto p : dead) {
+        delete p;
+    }
+    root       = Node::build(live, 0, live.size(), height);
+    Node::makeRoot(root);
+    nodes      = live.size();
+    tombstones = 0;
+    version++;
+}
+
+
+
+/*
+ *  Muss aufgerufen werden, nachdem die Val-Werte im Knoten mit dem Schlüssel k
+ *  verändert wurden, damit die Aggregate der Unterbäume wieder stimmen.
+ *  Schlüssel muss sich im Baum befinden
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: refresh (Key k)
+{
+    Node::refresh(root, k);
+}
+
+
+
+/*
+ *  Aggregat über alle Schlüssel von lo bis hi (einschließlich) in O(log n)
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+typename Agg::Type AVL_Tree<Key, Val, Agg, Balancing, Links> :: reduce (Key lo, Key hi)
+{
+    return Node::reduce(root, lo, hi, true, true);
+}
+
+
+
+/*
+ *  Alle Knoten (ohne Grabsteine) in aufsteigender Reihenfolge an f übergeben
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename Function>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: for_each (Function f)
+{
+    auto                    alive = [&f] (Node* p) { if (! p->dead) f(p); };
+
+    Node::forEach(root, alive);
+}
+
+
+
+/*
+ *  Alle Knoten (ohne Grabsteine) an f übergeben, verteilt auf den gemeinsamen Thread-Pool;
+ *  die Reihenfolge ist beliebig und f muss nebenläufig aufrufbar sein.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename Function>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: parallel_for_each (Function f)
+{
+    forEachIn(f, nullptr);
+}
+
+
+
+/*
+ *  Wie parallel_for_each(f), aber mit den Threads von pool
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename Function>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: parallel_for_each (Function f, AVL_ThreadPool& pool)
+{
+    forEachIn(f, &pool);
+}
+
+
+
+/*
+ *  Die Arbeit von parallel_for_each; pool wie bei splitPool
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename Function>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: forEachIn (Function f, AVL_ThreadPool* pool)
+{
+    vector<pair<Node*, bool>>   parts;
+    vector<function<void()>>    tasks;
+    int                         depth;
+    AVL_ThreadPool*             workers = splitPool(pool, depth);
+    auto                        alive = [&f] (Node* p) { if (! p->dead) f(p); };
+
+    if (workers == nullptr) {
+        Node::forEach(root, alive);
+        return;
+    }
+    Node::partition(root, depth, parts);
+    for (auto& part : parts) {
+        if (part.second) {
+            Node* p = part.first;
+            tasks.push_back([p, &alive] { Node::forEach(p, alive); });
+        }
+    }
+    workers->run(tasks);
+    for (auto& part : parts) {
+        if (! part.second) {
+            alive(part.first);
+        }
+    }
+}
+
+
+
+/*
+ *  Bildet jeden Knoten (ohne Grabsteine) mit map ab und verknüpft die Ergebnisse
+ *  in aufsteigender Schlüsselreihenfolge mit combine (muss assoziativ sein).
+ *  Die Unterbäume werden im gemeinsamen Thread-Pool parallel reduziert.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename T, typename Map, typename Combine>
+T AVL_Tree<Key, Val, Agg, Balancing, Links> :: parallel_reduce (T identity, Map map, Combine combine)
+{
+    return reduceIn(identity, map, combine, nullptr);
+}
+
+
+
+/*
+ *  Wie parallel_reduce(identity, map, combine), aber mit den Threads von pool
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename T, typename Map, typename Combine>
+T AVL_Tree<Key, Val, Agg, Balancing, Links> :: parallel_reduce (T identity, Map map, Combine combine, AVL_ThreadPool& pool)
+{
+    return reduceIn(identity, map, combine, &pool);
+}
+
+
+
+/*
+ *  Die Arbeit von parallel_reduce; pool wie bei splitPool
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+template <typename T, typename Map, typename Combine>
+T AVL_Tree<Key, Val, Agg, Balancing, Links> :: reduceIn (T identity, Map map, Combine combine, AVL_ThreadPool* pool)
+{
+    struct Result
+    {
+        T                       value;
+    };
+    vector<pair<Node*, bool>>   parts;
+    vector<Result>              results;
+    vector<function<void()>>    tasks;
+    int                         depth;
+    AVL_ThreadPool*             workers = splitPool(pool, depth);
+    T                           total = identity;
+
+    Node::partition(root, depth, parts);
+    results.assign(parts.size(), Result{identity});
+    for (size_t i = 0; i < parts.size(); i++) {
+        Node* p = parts[i].first;
+        T* r = &results[i].value;
+        if (parts[i].second) {
+            tasks.push_back([p, r, &map, &combine] {
+                auto f = [r, &map, &combine] (Node* q) { if (! q->dead) *r = combine(*r, map(q)); };
+                Node::forEach(p, f);
+            });
+        }
+        else if (! p->dead) {
+            *r = map(p);
+        }
+    }
+    if (workers == nullptr) {   // nur ein einziger Unterbaum, den rechnet der Aufrufer selbst
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+    else {
+        workers->run(tasks);
+    }
+    for (auto& r : results) {
+        total = combine(total, r.value);
+    }
+    return total;
+}
+
+
+
+/*
+ *  Macht sich zunutze, dass bei der Höhenberechnung die AVL-Struktur
+ *  überprüft wird, und vergleicht das Ergebnis mit der gespeicherten Höhe.
+ *  Bei großen Bäumen werden die Unterbäume unterhalb von splitDepth
+ *  im gemeinsamen Pool parallel geprüft und nur die Spitze seriell;
+ *  kleine Bäume prüft der Aufrufer allein, ohne den Pool anzulegen.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: check ()
+{
+    checkIn(nullptr);
+}
+
+
+
+/*
+ *  Wie check(), aber mit den Threads von pool
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: check (AVL_ThreadPool& pool)
+{
+    checkIn(&pool);
+}
+
+
+
+/*
+ *  Die Arbeit von check; pool wie bei splitPool
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: checkIn (AVL_ThreadPool* pool)
+{
+    vector<pair<Node*, bool>>   parts;
+    vector<function<void()>>    tasks;
+    vector<int>                 heights;
+    size_t                      next = 0;
+    int                         depth;
+    AVL_ThreadPool*             workers = splitPool(pool, depth);
+
+    if (root != nullptr && ! root->isChildOf(nullptr)) {
+        throw "Parent link not in line!";
+    }
+    if (workers == nullptr) {
+        if (Node::calcHeight(root) != height) {
+            throw "Height not in line!";
+        }
+        return;
+    }
+    Node::partition(root, depth, parts);
+    heights.assign(parts.size(), 0);
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (parts[i].second) {
+            Node* p = parts[i].first;
+            int* h = &heights[i];
+            tasks.push_back([p, h] { *h = Node::calcHeight(p); });
+        }
+    }
+    workers->run(tasks);
+    if (Node::calcHeight(root, depth, heights, next) != height) {
+        throw "Height not in line!";
+    }
+}
+
+
+
+/*
+ *  Prüfung in kleinen Portionen, die auch im laufenden Betrieb
+ *  zwischen den Operationen aufgerufen werden kann (nicht nebenläufig zu ihnen).
+ *
+ *  Jeder Aufruf prüft die gespeicherte Höhe, dann vorrangig die Pfade
+ *  der seit dem letzten Aufruf geänderten Schlüssel und setzt schließlich
+ *  die Runde durch den Baum fort, bis budget Einheiten verbraucht sind.
+ *  Die Pfade bekommen höchstens die (aufgerundete) Hälfte des Budgets,
+ *  damit die Runde auch bei ständigen Änderungen vorankommt (ab budget 2).
+ *  Jede Einheit (ein Knoten bzw. ein Pfad) kostet höchstens O(log² n),
+ *  gemerkt wird nur der zuletzt geprüfte Schlüssel.
+ *  Liefert true, wenn damit eine Runde durch den ganzen Baum beendet ist.
+ *  Wirft wie check() bei einer Verletzung.
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Tree<Key, Val, Agg, Balancing, Links> :: checkStep (unsigned budget)
+{
+    Node*                   p;
+
+    if (Balancing::height(root) != height) {
+        throw "Height not in line!";
+    }
+    for (unsigned paths = (budget + 1) / 2; paths > 0 && ! touched.empty(); paths--) {
+        Node::checkPath(root, touched.back());
+        touched.pop_back();
+        budget--;
+    }
+    while (budget > 0) {
+        if ((p = Node::checkNext(root, cursor, ! cursorValid)) == nullptr) {
+            cursorValid = false;
+            return true;
+        }
+        cursor = p->key;
+        cursorValid = true;
+        budget--;
+    }
+    return false;
+}
+
+
+
+/*
+ *  Ein bisschen Eye-Candy zu Testzwecken
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Tree<Key, Val, Agg, Balancing, Links> :: display ()
+{
+    Node::display(root, height);
+    try {
+        cout << endl << "AVL-Status: ";
+        check();
+        cout << "Good";
+    } catch (const char* s) {
+         cout << " – Aww!";
+    }
+    cout << endl << endl;
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Der Recorder
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktor – legt die Datei an und schreibt den Kopf
+ */
+template <typename Key>
+AVL_Recorder<Key> :: AVL_Recorder (const char* fileName) : out(fileName, ios::binary | ios::trunc)
+{
+    AVL_TraceHeader         header = {{'A', 'V', 'L', 'T'}, 1, sizeof(Key), {0, 0}};
+
+    static_assert(sizeof(Key) < 256, "Key too large for trace!");
+    if (! out) {
+        throw "Can’t open trace file!";
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.reserve(bufferSize + 1 + sizeof(Key));
+}
+
+
+
+/*
+ *  Destruktor – schreibt den Rest des Puffers
+ */
+template <typename Key>
+AVL_Recorder<Key> :: ~AVL_Recorder ()
+{
+    flush();
+}
+
+
+
+/*
+ *  Eine Operation anhängen; geschrieben wird in Blöcken von bufferSize
+ */
+template <typename Key>
+void AVL_Recorder<Key> :: log (Op op, Key k)
+{
+    size_t                  n = buffer.size();
+
+    buffer.resize(n + 1 + sizeof(Key));
+    buffer[n] = char(op);
+    memcpy(&buffer[n + 1], &k, sizeof(Key));
+    if (buffer.size() >= bufferSize) {
+        flush();
+    }
+}
+
+
+
+/*
+ *  Puffer in die Datei schreiben
+ */
+template <typename Key>
+void AVL_Recorder<Key> :: flush ()
+{
+    out.write(buffer.data(), buffer.size());
+    out.flush();
+    buffer.clear();
+}
+
+
+
+
+
+/*
+ *  ======================================================================
+ *  Der Block-Baum
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Position des ersten Schlüssels, der nicht kleiner als k ist,
+ *  in dem sortierten Feld keys der Länge n.
+ *  Allgemein per binärer Suche, für Zahlen durch Zählen aller kleineren
+ *  ohne Verzweigungen, für int explizit mit SSE2 und für int64_t mit SSE4.2
+ *  (etwa -msse4.2 oder -march=native; der 64-Bit-Vergleich ließe sich mit SSE2
+ *  nachbilden, wäre aber langsamer als die Zählschleife).
+ *  Ob der Compiler die Zählschleife für andere Typen vektorisiert, hängt
+ *  von ihm und den Optionen ab (GCC 12 etwa nicht bei -O2).
+ */
+template <typename Key>
+inline unsigned blockLowerBound (Key* keys, unsigned n, Key& k, false_type)
+{
+    unsigned                lo = 0;
+    unsigned                hi = n;
+
+    while (lo < hi) {
+        unsigned m = (lo + hi) / 2;
+        if (keys[m] < k) {
+            lo = m + 1;
+        }
+        else {
+            hi = m;
+        }
+    }
+    return lo;
+}
+
+template <typename Key>
+inline unsigned blockLowerBound (Key* keys, unsigned n, Key& k, true_type)
+{
+    unsigned                c = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        c += keys[i] < k;
+    }
+    return c;
+}
+
+#ifdef __SSE2__
+inline unsigned blockLowerBound (int* keys, unsigned n, int& k, true_type)
+{
+    __m128i                 kk = _mm_set1_epi32(k);
+    __m128i                 sum = _mm_setzero_si128();   // zählt je Spur die kleineren (-1 je Treffer)
+    unsigned                c;
+    unsigned                i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        sum = _mm_sub_epi32(sum, _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), kk));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    c = unsigned(_mm_cvtsi128_si32(sum));
+    for (; i < n; i++) {
+        c += keys[i] < k;
+    }
+    return c;
+}
+#endif
+
+#ifdef __SSE4_2__
+inline unsigned blockLowerBound (int64_t* keys, unsigned n, int64_t& k, true_type)
+{
+    __m128i                 kk = _mm_set1_epi64x(k);
+    __m128i                 sum = _mm_setzero_si128();
+    unsigned                c;
+    unsigned                i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        sum = _mm_sub_epi64(sum, _mm_cmpgt_epi64(kk, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i))));
+    }
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+    c = unsigned(_mm_cvtsi128_si32(sum));
+    for (; i < n; i++) {
+        c += keys[i] < k;
+    }
+    return c;
+}
+#endif
+
+
+
+/*
+ *  Konstruktor – legt den (leeren) Block an
+ */
+template <typename Key, unsigned Bytes>
+AVL_Block<Key, Bytes> :: AVL_Block ()
+{
+    void*                   p;
+
+    if (posix_memalign(&p, 64, capacity * sizeof(Key)) != 0) {
+        throw "Out of memory!";
+    }
+    keys  = static_cast<Key*>(p);
+    count = 0;
+    for (unsigned i = 0; i < capacity; i++) {
+        new (keys + i) Key();
+    }
+}
+
+
+
+/*
+ *  Destruktor – gibt den Block frei
+ */
+template <typename Key, unsigned Bytes>
+AVL_Block<Key, Bytes> :: ~AVL_Block ()
+{
+    for (unsigned i = 0; i < capacity; i++) {
+        keys[i].~Key();
+    }
+    free(keys);
+}
+
+
+
+/*
+ *  Position des ersten Schlüssels im Block, der nicht kleiner als k ist
+ */
+template <typename Key, unsigned Bytes>
+unsigned AVL_Block<Key, Bytes> :: lowerBound (Key k)
+{
+    return blockLowerBound(keys, count, k, integral_constant<bool, is_arithmetic<Key>::value>());
+}
+
+
+
+/*
+ *  Die Schlüssel des Blocks anzeigen
+ */
+template <typename Key, unsigned Bytes>
+void AVL_Block<Key, Bytes> :: displayVal ()
+{
+    cout << "   {";
+    for (unsigned i = 0; i < count; i++) {
+        cout << (i > 0 ? " " : "") << keys[i];
+    }
+    cout << "}";
+}
+
+
+
+/*
+ *  Konstruktor
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+AVL_BlockTree<Key, Bytes, Balancing> :: AVL_BlockTree () : Tree()
+{
+}
+
+
+
+/*
+ *  Höhe des Baums aus Blöcken
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+int AVL_BlockTree<Key, Bytes, Balancing> :: getHeight ()
+{
+    return Tree::getHeight();
+}
+
+
+
+/*
+ *  Der Block, in den k gehört: der mit dem größten Schlüssel <= k,
+ *  oder nullptr, wenn k kleiner als alle Schlüssel ist.
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+AVL_Node<Key, AVL_Block<Key, Bytes>, NoAgg, Balancing>* AVL_BlockTree<Key, Bytes, Balancing> :: floor (Key k)
+{
+    Node*                   p = this->root;
+    Node*                   found = nullptr;
+
+    while (p != nullptr) {
+        if (k < p->key) {
+            p = p->smaller;
+        }
+        else {
+            found = p;
+            p = p->greater;
+        }
+    }
+    return found;
+}
+
+
+
+/*
+ *  Der auf p folgende Block oder nullptr
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+AVL_Node<Key, AVL_Block<Key, Bytes>, NoAgg, Balancing>* AVL_BlockTree<Key, Bytes, Balancing> :: next (Node* p)
+{
+    Node*                   q = this->root;
+    Node*                   found = nullptr;
+
+    while (q != nullptr) {
+        if (p->key < q->key) {
+            found = q;
+            q = q->smaller;
+        }
+        else {
+            q = q->greater;
+        }
+    }
+    return found;
+}
+
+
+
+/*
+ *  Der p vorausgehende Block oder nullptr
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+AVL_Node<Key, AVL_Block<Key, Bytes>, NoAgg, Balancing>* AVL_BlockTree<Key, Bytes, Balancing> :: prev (Node* p)
+{
+    Node*                   q = this->root;
+    Node*                   found = nullptr;
+
+    while (q != nullptr) {
+        if (q->key < p->key) {
+            found = q;
+            q = q->greater;
+        }
+        else {
+            q = q->smaller;
+        }
+    }
+    return found;
+}
+
+
+
+/*
+ *  Einen zu weniger als einem Viertel gefüllten Block p mit seinem Nachfolger
+ *  (der letzte Block mit seinem Vorgänger) zusammenlegen, sofern beide zusammen
+ *  höchstens einen halben Block füllen, sonst die Schlüssel gleichmäßig auf beide
+ *  verteilen. Damit ist jeder Block (außer einem einzigen) mindestens zu einem Viertel gefüllt.
+ *  Die Knoten selbst bleiben beim Löschen erhalten (remove tauscht nur Zeiger).
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+void AVL_BlockTree<Key, Bytes, Balancing> :: merge (Node* p)
+{
+    Node*                   a;   // der vordere
+    Node*                   b;   // und der hintere Block
+    unsigned                m;
+
+    if (p->count >= Block::capacity / 4) {
+        return;
+    }
+    if ((b = next(p)) != nullptr) {
+        a = p;
+    }
+    else if ((a = prev(p)) != nullptr) {
+        b = p;
+    }
+    else {
+        return;
+    }
+
+    if (a->count + b->count <= Block::capacity / 2) {
+        copy(b->keys, b->keys + b->count, a->keys + a->count);
+        a->count += b->count;
+        Tree::remove(b->key);
+        return;
+    }
+    m = (a->count + b->count) / 2;   // so viele bleiben vorne
+    if (a->count < m) {
+        unsigned d = m - a->count;
+        copy(b->keys, b->keys + d, a->keys + a->count);
+        copy(b->keys + d, b->keys + b->count, b->keys);
+        b->count -= d;
+    }
+    else {
+        unsigned d = a->count - m;
+        copy_backward(b->keys, b->keys + b->count, b->keys + b->count + d);
+        copy(a->keys + m, a->keys + a->count, b->keys);
+        b->count += d;
+    }
+    a->count = m;
+    b->key = b->keys[0];   // bleibt zwischen a und dem nächsten Block
+}
+
+
+
+/*
+ *  Schlüssel k suchen
  */
-template <typename Key, typename Val>
-bool AVL_Node<Key, Val> :: insert (AVL_Node*& p, Key k, AVL_Node*& inserted)
+template <typename Key, unsigned Bytes, typename Balancing>
+const Key* AVL_BlockTree<Key, Bytes, Balancing> :: find (Key k)
 {
-    if (p == nullptr) {
-        inserted = p = new AVL_Node(k);   // neuen Knoten anlegen und zusätzlich in inserted merken
-        if (inserted == nullptr) {
-            throw "Out of memory!";
-        }
-        return true;   // Höhenänderung durch den neuen Knoten
+    Node*                   p = floor(k);
+    unsigned                i;
+
+    if (p == nullptr || (i = p->lowerBound(k)) == p->count || p->keys[i] != k) {
+        return nullptr;
     }
-    else if (k < p->key) {
-        if (insert(p->smaller, k, inserted)) {
-            return rebalance(p, -1, true);
-        }
+    return &p->keys[i];
+}
+
+
+
+/*
+ *  Schlüssel k einfügen
+ *  Schlüssel darf nicht schon im Baum enthalten sein
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+const Key* AVL_BlockTree<Key, Bytes, Balancing> :: insert (Key k)
+{
+    Node*                   p;
+    Node*                   q;
+    unsigned                i;
+
+    if (this->root == nullptr) {
+        p = Tree::insert(k);
+        p->keys[0] = k;
+        p->count = 1;
+        return &p->keys[0];
     }
-    else if (k > p->key) {
-        if (insert(p->greater, k, inserted)) {
-            return rebalance(p, +1, true);
+    if ((p = floor(k)) == nullptr) {   // kleiner als alle: in den ersten Block
+        for (p = this->root; p->smaller != nullptr; p = p->smaller) {
         }
     }
-    else {
+    i = p->lowerBound(k);
+    if (i < p->count && p->keys[i] == k) {
         throw "Key to insert already in tree!";
     }
-    return false;   // Höhenänderung abgefangen
+
+    if (p->count == Block::capacity) {   // voll: obere Hälfte in einen neuen Block
+        unsigned h = p->count / 2;
+        q = Tree::insert(p->keys[h]);
+        copy(p->keys + h, p->keys + p->count, q->keys);
+        q->count = p->count - h;
+        p->count = h;
+        if (i > h) {
+            p = q;
+            i -= h;
+        }
+    }
+
+    copy_backward(p->keys + i, p->keys + p->count, p->keys + p->count + 1);
+    p->keys[i] = k;
+    p->count++;
+    if (i == 0) {
+        p->key = k;   // neues Minimum, liegt noch immer hinter dem Vorgänger-Block
+    }
+    return &p->keys[i];
 }
 
 
 
 /*
- *  Schlüssel k aus dem Baum p entfernen.
+ *  Schlüssel k löschen
+ *  Schlüssel muss sich im Baum befinden
  */
-template <typename Key, typename Val>
-bool AVL_Node<Key, Val> :: remove (AVL_Node*& p, Key k)
+template <typename Key, unsigned Bytes, typename Balancing>
+void AVL_BlockTree<Key, Bytes, Balancing> :: remove (Key k)
 {
-    AVL_Node*                    q;
-    AVL_Node*                    r;
+    Node*                   p = floor(k);
+    unsigned                i;
 
-    if (p == nullptr) {
+    if (p == nullptr || (i = p->lowerBound(k)) == p->count || p->keys[i] != k) {
         throw "Key to delete not in tree!";
     }
-    else if (k < p->key) {
-        if (remove(p->smaller, k)) {
-            return rebalance(p, +1, false);
-        }
-    }
-    else if (k > p->key) {
-        if (remove(p->greater, k)) {
-            return  rebalance(p, -1, false);
-        }
-    }
-    else if (p->greater == nullptr || p->smaller == nullptr) {
-        if (p->greater == nullptr) {   // Ist p->key bereits das größte Element im Baum?
-            q = p->smaller;   // leerer Baum oder Blatt
-        }
-        else {
-            q = p->greater;   // Blatt
-        }
-        delete p;   // Element löschen und
-        p = q;   // durch Blatt (or leeren Baum) ersetzen
-        return true;   // Höhenänderung durch das Löschen
+    if (p->count == 1) {
+        Tree::remove(k);
+        return;
     }
-    else {
-        q = p->greater;
-        r = p;
-        while (q->smaller != nullptr) {   // kleinstes Element im Unterbaum p->greater finden
-            r = q;   // und auch den Vorgänger darauf merken
-            q = q->smaller;
-        }
+    copy(p->keys + i + 1, p->keys + p->count, p->keys + i);
+    p->count--;
+    p->key = p->keys[0];
+    merge(p);
+}
 
-        /*
-         *  Da wir nichts über die ererbte Val-Struktur wissen,
-         *  reicht es nicht, einfach die Schlüssel auszutauschen.
-         *  Wir setzen stattdessen alle Zeiger und die Balance um.
-         */
-        if (r != p) {   // Der Vorgänger von q muss hinterher auf p zeigen,
-            r->smaller = p;
-        }
-        else {   // selbst wenn es p selbst ist; nach dem Tausch von p und q wird q dann auf p zeigen.
-            r->greater = p;
-        }
-        swap(p->smaller, q->smaller);
-        swap(p->greater, q->greater);
-        swap(p->balance, q->balance);
-        swap(p, q);   // Bedeutung von p und q umsetzen
 
-        if (remove(p->greater, k)) {   // und das gewünschte Element aus dem Unterbaum löschen
-            return rebalance(p, -1, false);   // und Baum rebalancieren
-        }
+
+/*
+ *  Nur einfügen, wenn k noch nicht im Baum ist
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+const Key* AVL_BlockTree<Key, Bytes, Balancing> :: safeInsert (Key k)
+{
+    const Key*              found;
+
+    if ((found = find(k)) == nullptr) {
+        found = insert(k);
     }
-    return false;   // Höhenänderung abgefangen
+    return found;
 }
 
 
 
 /*
- *  Höhe des Baum p tatsächlich berechnen;
- *  bricht mit Fehlermeldung ab,
- *  wenn AVL-Kriterium verletzt ist
- *  oder Balance und Höhe der Unterbäume nicht zueinander passen.
+ *  Nur löschen, wenn k im Baum ist
  */
-template <typename Key, typename Val>
-int AVL_Node<Key, Val> :: calcHeight (AVL_Node* p)
+template <typename Key, unsigned Bytes, typename Balancing>
+void AVL_BlockTree<Key, Bytes, Balancing> :: safeRemove (Key k)
 {
-    if (p == nullptr) {
-        return 0;
+    if (find(k) != nullptr) {
+        remove(k);
     }
-    else {
-        int h1 = calcHeight(p->smaller);
-        int h2 = calcHeight(p->greater);
-        if (abs(h1 - h2) > 1) {
-            throw "No AVL tree!";
-        }
-        else if (h2 - h1 != p->balance) {
-            throw "Balance not in line!";
+}
+
+
+
+/*
+ *  Alle Schlüssel in aufsteigender Reihenfolge an f übergeben
+ */
+template <typename Key, unsigned Bytes, typename Balancing>
+template <typename Function>
+void AVL_BlockTree<Key, Bytes, Balancing> :: for_each (Function f)
+{
+    Tree::for_each([&f] (Node* p) {
+        for (unsigned i = 0; i < p->count; i++) {
+            f(const_cast<const Key&>(p->keys[i]));
         }
-        return max(h1, h2) + 1;
-    }
+    });
 }
 
 
 
 /*
- *  Gibt einfach n-mal acht Leerzeichen aus.
- *  Wer sich bei dem Namen der Methode an sense8 erinnert fühlt,
- *  könnte damit richtigliegen …
+ *  AVL-Struktur der Blöcke prüfen, dazu jeden Block für sich (auch den Füllstand)
+ *  und dass jeder Block hinter seinem Vorgänger liegt.
  */
-template <typename Key, typename Val>
-void AVL_Node<Key, Val> :: space8 (unsigned n)
+template <typename Key, unsigned Bytes, typename Balancing>
+void AVL_BlockTree<Key, Bytes, Balancing> :: check ()
 {
-    for (unsigned i = 0; i < n; i++) {
-        cout << "        ";
-    }
+    Node*                   last = nullptr;
+    bool                    single = this->root != nullptr
+                                     && this->root->smaller == nullptr && this->root->greater == nullptr;
+
+    Tree::check();
+    Tree::for_each([single, &last] (Node* p) {
+        if (p->count == 0 || p->count > Block::capacity || p->key != p->keys[0]) {
+            throw "Block not in line!";
+        }
+        if (p->count < Block::capacity / 4 && ! single) {
+            throw "Block too empty!";
+        }
+        for (unsigned i = 1; i < p->count; i++) {
+            if (! (p->keys[i - 1] < p->keys[i])) {
+                throw "Keys not in order!";
+            }
+        }
+        if (last != nullptr && ! (last->keys[last->count - 1] < p->keys[0])) {
+            throw "Keys not in order!";
+        }
+        last = p;
+    });
 }
 
 
 
 /*
- *  Zaubert eine Darstellung des Baums auf den Bildschirm.
+ *  Ein bisschen Eye-Candy zu Testzwecken
  */
-template <typename Key, typename Val>
-void AVL_Node<Key, Val> :: display (AVL_Node* p, int h, char c)
+template <typename Key, unsigned Bytes, typename Balancing>
+void AVL_BlockTree<Key, Bytes, Balancing> :: display ()
 {
-    if (p != nullptr) {
-        display(p->smaller, h-1, 'L');
-        space8(h);
-        cout << c << h << ": " << p->key << " (" << p->balance << ")";
-        p->displayVal();
-        cout << endl;
-        display(p->greater, h-1, 'R');
-    }
-    else {
-        space8(h);
-        cout << c << h << ": " << "÷" << endl;
-    }
+    Tree::display();
 }
 
 
@@ -449,177 +4207,343 @@ void AVL_Node<Key, Val> :: display (AVL_Node* p, int h, char c)
 
 /*
  *  ======================================================================
- *  Die nicht statischen Knoten-Methoden
+ *  Der Combiner
  *  ======================================================================
  */
 
 
 
 /*
- *  Konstruktor – Val muss einen Standard-Konstruktor anbieten
+ *  Konstruktor – size Fächer; mehr Threads als Fächer müssen sich die Fächer teilen
  */
-template <typename Key, typename Val>
-AVL_Node<Key, Val> :: AVL_Node (Key k) : Val ()
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Combiner<Key, Val, Agg, Balancing, Links> :: AVL_Combiner (Tree& t, unsigned size) : tree(t)
 {
-    smaller = nullptr;
-    greater = nullptr;
-    balance = 0;
-    key     = k;
+    void*                   p;
+
+    n      = max(size, 1u);
+    stride = (sizeof(Slot) + 63) / 64 * 64;
+    if (posix_memalign(&p, 64, n * stride) != 0) {
+        throw "Out of memory!";
+    }
+    slots = static_cast<char*>(p);
+    for (unsigned i = 0; i < n; i++) {
+        new (slot(i)) Slot();
+        slot(i)->state = Free;
+    }
+    batch.reserve(n);   // combine soll nicht mehr allozieren müssen
+    busy = false;
 }
 
 
 
 /*
- *  Wer extern den Schlüssel aus dem Knoten extrahieren will …
+ *  Destruktor
  */
-template <typename Key, typename Val>
-Key AVL_Node<Key, Val> :: getKey ()
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+AVL_Combiner<Key, Val, Agg, Balancing, Links> :: ~AVL_Combiner ()
 {
-    return key;
+    for (unsigned i = 0; i < n; i++) {
+        slot(i)->~Slot();
+    }
+    free(slots);
 }
 
 
 
+/*
+ *  Das i-te Fach
+ */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+typename AVL_Combiner<Key, Val, Agg, Balancing, Links>::Slot* AVL_Combiner<Key, Val, Agg, Balancing, Links> :: slot (unsigned i)
+{
+    return reinterpret_cast<Slot*>(slots + i * stride);
+}
+
 
 
 /*
- *  ======================================================================
- *  Die Baum-Methoden
- *
- *  rufen im Wesentlichen die entsprechenden Methoden
- *  aus der Knotenklasse mit der Wurzel als Parameter auf.
- *  ======================================================================
+ *  Operation op mit Schlüssel k in einem Fach ablegen und warten, bis sie ausgeführt ist.
+ *  Ist die Combiner-Rolle frei, übernimmt der Thread sie selbst und führt dabei
+ *  auch die Operationen aller anderen aus.
+ *  Jeder Thread beginnt bei „seinem“ Fach, das er so meist im Cache behält.
  */
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Combiner<Key, Val, Agg, Balancing, Links> :: apply (Op op, Key k)
+{
+    unsigned                start = hash<thread::id>()(this_thread::get_id()) % n;
+    unsigned                i = start;
+    Slot*                   s;
+    int                     expected;
+    bool                    result;
+    exception_ptr           error;
+
+    while (true) {   // freies Fach belegen
+        s = slot(i);
+        expected = Free;
+        if (s->state.load(memory_order_relaxed) == Free
+                && s->state.compare_exchange_strong(expected, Claimed, memory_order_acquire)) {
+            break;
+        }
+        if ((i = (i + 1) % n) == start) {
+            this_thread::yield();
+        }
+    }
+    s->op    = op;
+    s->key   = k;
+    s->error = nullptr;
+    s->state.store(Posted, memory_order_release);
+
+    while (s->state.load(memory_order_acquire) != Done) {
+        if (! busy.load(memory_order_relaxed) && ! busy.exchange(true, memory_order_acquire)) {
+            Role role(busy);
+            combine();
+        }
+        else {
+            this_thread::yield();
+        }
+    }
+    result = s->result;
+    error  = s->error;
+    s->error = nullptr;
+    s->state.store(Free, memory_order_release);
+    if (error) {
+        rethrow_exception(error);
+    }
+    return result;
+}
 
 
 
 /*
- *  Konstruktor
+ *  Als Combiner alle abgelegten Operationen einsammeln und sortiert ausführen;
+ *  aufeinanderfolgende Schlüssel liegen nahe beieinander, der Finger steigt
+ *  also jeweils nur wenig auf und ab.
+ *  Jede Ausnahme (auch bad_alloc) wird im Fach abgelegt und im jeweiligen Thread
+ *  weitergeworfen, die übrigen Operationen des Stapels laufen trotzdem.
  */
-template <typename Key, typename Val>
-AVL_Tree<Key, Val> :: AVL_Tree ()
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+void AVL_Combiner<Key, Val, Agg, Balancing, Links> :: combine ()
 {
-    root   = nullptr;
-    height = 0;
+    auto collect = [this] {
+        batch.clear();
+        for (unsigned i = 0; i < n; i++) {
+            if (slot(i)->state.load(memory_order_acquire) == Posted) {
+                batch.push_back(slot(i));
+            }
+        }
+    };
+
+    collect();
+    try {
+        sort(batch.begin(), batch.end(), [] (Slot* a, Slot* b) { return a->key < b->key; });
+    } catch (...) {
+        collect();   // ein Vergleich hat geworfen: unsortiert abarbeiten, die Fehler landen in den Fächern
+    }
+
+    for (auto s : batch) {
+        try {
+            s->result = (tree.find_near(finger, s->key) != nullptr);
+            switch (s->op) {
+            case Insert:
+                if (! s->result) {
+                    tree.insert(finger, s->key);
+                }
+                s->result = ! s->result;
+                break;
+            case Remove:
+                if (s->result) {
+                    tree.remove(finger, s->key);
+                }
+                break;
+            case Find:
+                break;
+            }
+        } catch (...) {
+            s->error = current_exception();
+        }
+        s->state.store(Done, memory_order_release);
+    }
 }
 
 
 
 /*
- *  Wer die Höhe wissen will …
+ *  Schlüssel k einfügen, falls noch nicht vorhanden (wie safeInsert);
+ *  liefert true, wenn er neu eingefügt wurde
  */
-template <typename Key, typename Val>
-int AVL_Tree<Key, Val> :: getHeight ()
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Combiner<Key, Val, Agg, Balancing, Links> :: insert (Key k)
 {
-    return height;
+    return apply(Insert, k);
 }
 
 
 
 /*
- *  Schlüssel k in dem Baum suchen
+ *  Schlüssel k löschen, falls vorhanden (wie safeRemove);
+ *  liefert true, wenn er gelöscht wurde
  */
-template <typename Key, typename Val>
-AVL_Node<Key, Val>* AVL_Tree<Key, Val> :: find (Key k)
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Combiner<Key, Val, Agg, Balancing, Links> :: remove (Key k)
 {
-    return Node::find(root, k);
+    return apply(Remove, k);
 }
 
 
 
 /*
- *  Schlüssel k in den Baum einfügen
- *  Schlüssel darf nicht schon im Baum enthalten sein
- *  Liefert einen Zeiger auf den neuen Knoten
+ *  Ist Schlüssel k im Baum?
  */
-template <typename Key, typename Val>
-AVL_Node<Key, Val>* AVL_Tree<Key, Val> :: insert (Key k)
+template <typename Key, typename Val, typename Agg, typename Balancing, typename Links>
+bool AVL_Combiner<Key, Val, Agg, Balancing, Links> :: find (Key k)
 {
-    Node*                   inserted = nullptr;
+    return apply(Find, k);
+}
 
-    if (Node::insert(root, k, inserted)) {
-        height++;
+
+
+
+
+#if __cplusplus >= 201402L
+/*
+ *  ======================================================================
+ *  Der statische Baum
+ *  ======================================================================
+ */
+
+
+
+/*
+ *  Konstruktor – zur Übersetzungszeit auswertbar:
+ *  Sortieren durch Einfügen, dann benachbarte Doppelte entfernen
+ *  und in Eytzinger-Anordnung ablegen
+ */
+template <typename Key, size_t N>
+constexpr AVL_StaticTree<Key, N> :: AVL_StaticTree (const Key (&k)[N]) : keys(), count(0)
+{
+    Key                     sorted[N] = {};
+
+    for (size_t i = 0; i < N; i++) {
+        size_t j = i;
+        while (j > 0 && k[i] < sorted[j - 1]) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = k[i];
     }
-    return inserted;
+    for (size_t i = 0; i < N; i++) {
+        if (count == 0 || sorted[count - 1] < sorted[i]) {
+            sorted[count++] = sorted[i];
+        }
+    }
+    layout(sorted, 1, 0);
 }
 
 
 
 /*
- *  Schlüssel k aus dem Baum löschen
- *  Schlüssel muss ich im Baum befinden
+ *  Den Unterbaum mit der Wurzel i in Schlüsselreihenfolge (inorder) aus sorted füllen;
+ *  next ist der nächste zu verteilende Schlüssel, zurückgegeben wird der danach.
  */
-template <typename Key, typename Val>
-void AVL_Tree<Key, Val> :: remove (Key k)
+template <typename Key, size_t N>
+constexpr size_t AVL_StaticTree<Key, N> :: layout (const Key* sorted, size_t i, size_t next)
 {
-    if (Node::remove(root, k)) {
-        height--;
+    if (i <= count) {
+        next = layout(sorted, 2 * i, next);
+        keys[i] = sorted[next++];
+        next = layout(sorted, 2 * i + 1, next);
     }
+    return next;
 }
 
 
 
 /*
- *  Es wird geprüft, ob sich der Schlüssel k bereits im Baum befindet,
- *  und nur, wenn nicht, insert aufgerufen.
+ *  Anzahl der (verschiedenen) Schlüssel
  */
-template <typename Key, typename Val>
-AVL_Node<Key, Val>* AVL_Tree<Key, Val> :: safeInsert (Key k)
+template <typename Key, size_t N>
+constexpr size_t AVL_StaticTree<Key, N> :: size () const
 {
-    Node*                   foundOrIserted;
+    return count;
+}
 
-    if ((foundOrIserted = find(k)) == nullptr) {
-        foundOrIserted = insert(k);
+
+
+/*
+ *  Höhe des vollständig ausgeglichenen Baums
+ */
+template <typename Key, size_t N>
+constexpr int AVL_StaticTree<Key, N> :: getHeight () const
+{
+    int                     h = 0;
+
+    for (size_t n = count; n > 0; n /= 2) {
+        h++;
     }
-    return foundOrIserted;
+    return h;
 }
 
 
 
 /*
- *  Es wird geprüft, ob sich der Schlüssel k im Baum befindet,
- *  und nur dann remove aufgerufen.
+ *  Schlüssel k suchen, ohne Verzweigung beim Abstieg:
+ *  i wandert immer bis unter ein Blatt; die Eins-Bits am Ende von i
+ *  sind die Schritte nach rechts nach dem letzten Schritt nach links,
+ *  wer sie (und diesen) abstreift, landet beim kleinsten Schlüssel >= k.
+ *  Liefert einen Zeiger auf den Schlüssel im Baum oder nullptr.
  */
-template <typename Key, typename Val>
-void AVL_Tree<Key, Val> :: safeRemove (Key k)
+template <typename Key, size_t N>
+constexpr const Key* AVL_StaticTree<Key, N> :: find (Key k) const
 {
-    if (find(k) != nullptr) {
-        remove(k);
+    size_t                  i = 1;
+
+    while (i <= count) {
+        i = 2 * i + (keys[i] < k);
+    }
+    while (i & 1) {
+        i >>= 1;
     }
+    i >>= 1;
+    return (i != 0 && ! (k < keys[i])) ? &keys[i] : nullptr;
 }
 
 
 
 /*
- *  Macht sich zunutze, dass bei der Höhenberechnung die AVL-Struktur
- *  überprüft wird, und vergleicht das Ergebnis mit der gespeicherten Höhe.
+ *  Alle Schlüssel in aufsteigender Reihenfolge an f übergeben
  */
-template <typename Key, typename Val>
-void AVL_Tree<Key, Val> :: check ()
+template <typename Key, size_t N>
+template <typename Function>
+void AVL_StaticTree<Key, N> :: for_each (Function f) const
 {
-    if (Node::calcHeight(root) != height) {
-        throw "Height not in line!";
+    forEach(1, f);
+}
+
+template <typename Key, size_t N>
+template <typename Function>
+void AVL_StaticTree<Key, N> :: forEach (size_t i, Function& f) const
+{
+    if (i <= count) {
+        forEach(2 * i, f);
+        f(keys[i]);
+        forEach(2 * i + 1, f);
     }
 }
 
 
 
 /*
- *  Ein bisschen Eye-Candy zu Testzwecken
+ *  Statischen Baum aus einem Feld von Schlüsseln bauen, ohne N anzugeben:
+ *      constexpr int keys[] = {…};
+ *      constexpr auto table = makeStaticTree(keys);
  */
-template <typename Key, typename Val>
-void AVL_Tree<Key, Val> :: display ()
+template <typename Key, size_t N>
+constexpr AVL_StaticTree<Key, N> makeStaticTree (const Key (&k)[N])
 {
-    Node::display(root, height);
-    try {
-        cout << endl << "AVL-Status: ";
-        check();
-        cout << "Good";
-    } catch (const char* s) {
-         cout << " – Aww!";
-    }
-    cout << endl << endl;
+    return AVL_StaticTree<Key, N>(k);
 }
+#endif
 
 
 
@@ -1,10 +1,10 @@
-TEMPLATE = app
-CONFIG += console c++11
-CONFIG -= app_bundle
-CONFIG -= qt
+TEMPLATE = subdirs
 
-SOURCES += \
-        main.cpp
+SUBDIRS += \
+        demo \
+        ingest \
+        replay
 
-HEADERS += \
-    FastAVL.hpp
+demo.file   = demo.pro
+ingest.file = ingest.pro
+replay.file = replay.pro
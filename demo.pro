@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = FastAVL
+CONFIG += console c++14 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+        main.cpp
+
+HEADERS += \
+    FastAVL.hpp
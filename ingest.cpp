@@ -0,0 +1,472 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "FastAVL.hpp"
+
+using namespace std;
+
+
+
+/*
+ *  ======================================================================
+ *  FastAVL-ingest
+ *
+ *  Lädt Schlüssel aus einer Datei in einen AVL_Tree<int64_t, NoVal>
+ *  und beantwortet anschließend die Anfragen aus einer zweiten Datei.
+ *
+ *      FastAVL-ingest [-b] [-w] [-t threads] keys [queries]
+ *
+ *  -b   Binärformat: int64-Werte in Maschinen-Byte-Reihenfolge
+ *       (die Dateigröße muss ein Vielfaches von 8 sein),
+ *       sonst Text: ganze Zahlen, getrennt durch beliebige andere Zeichen
+ *  -w   WAVL_Balancing statt des klassischen AVL-Baums
+ *  -t   Anzahl der Threads, 1 bis 1024 (Voreinstellung: alle Kerne)
+ *
+ *  Die Datei wird per mmap eingeblendet und in Stücke geteilt,
+ *  die parallel eingelesen und sortiert werden.
+ *  Sobald ein Stück fertig ist, fügt der Haupt-Thread es ein,
+ *  während die übrigen noch gelesen werden (Pipeline); damit ein schneller
+ *  Leser nicht die ganze Datei zwischenspeichert, warten höchstens
+ *  2 * threads fertige Stücke. Innerhalb eines Stücks wird per Finger-Suche eingefügt.
+ *
+ *  Zu den Anfragen werden Treffer, Fehlschläge und die Summe (modulo 2^64)
+ *  der gefundenen Schlüssel ausgegeben, mit der sich das Ergebnis unabhängig
+ *  vom Baum nachprüfen lässt.
+ *  ======================================================================
+ */
+
+
+
+using Clock = chrono::steady_clock;
+
+
+
+/*
+ *  Eine per mmap eingeblendete Datei
+ */
+class MappedFile
+{
+public:
+    const char*             data;
+    size_t                  size;
+
+    MappedFile (const char* name)
+    {
+        struct stat         st;
+        int                 fd = open(name, O_RDONLY);
+
+        data = nullptr;
+        size = 0;
+        if (fd < 0) {
+            throw "Can’t open file!";
+        }
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw "Can’t open file!";
+        }
+        size = st.st_size;
+        if (size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw "Can’t map file!";
+            }
+            madvise(p, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(p);
+        }
+        close(fd);
+    }
+
+    ~MappedFile ()
+    {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+};
+
+
+
+/*
+ *  Die fertig sortierten Stücke, vom Lesen (Erzeuger) zum Einfügen (Verbraucher);
+ *  es warten höchstens capacity Stücke, push blockiert so lange
+ */
+class ChunkQueue
+{
+protected:
+    mutex                   lock;
+    condition_variable      ready;
+    condition_variable      space;
+    deque<vector<int64_t>>  chunks;
+    size_t                  missing;    // noch nicht abgelieferte Stücke
+    size_t                  capacity;
+    bool                    aborted;    // der Verbraucher holt nichts mehr ab
+
+public:
+    ChunkQueue (size_t n, size_t c)
+    {
+        missing  = n;
+        capacity = max<size_t>(c, 1);
+        aborted  = false;
+    }
+
+    void push (vector<int64_t>&& chunk)
+    {
+        unique_lock<mutex> guard(lock);
+        space.wait(guard, [this] { return chunks.size() < capacity || aborted; });
+        if (! aborted) {
+            chunks.push_back(move(chunk));
+        }
+        missing--;
+        ready.notify_one();
+    }
+
+    // ein Stück kommt nicht (Fehler beim Lesen), der Verbraucher soll nicht ewig warten
+    void fail ()
+    {
+        lock_guard<mutex> guard(lock);
+        missing--;
+        ready.notify_one();
+    }
+
+    // false, wenn alle Stücke abgeholt sind
+    bool pop (vector<int64_t>& chunk)
+    {
+        unique_lock<mutex> guard(lock);
+        ready.wait(guard, [this] { return ! chunks.empty() || missing == 0; });
+        if (chunks.empty()) {
+            return false;
+        }
+        chunk = move(chunks.front());
+        chunks.pop_front();
+        space.notify_one();
+        return true;
+    }
+
+    // der Verbraucher gibt auf: wartende und künftige push verwerfen ihr Stück
+    void abort ()
+    {
+        lock_guard<mutex> guard(lock);
+        aborted = true;
+        chunks.clear();
+        space.notify_all();
+    }
+};
+
+
+
+/*
+ *  Ist c Teil einer Zahl im Textformat?
+ */
+inline bool isNumberChar (char c)
+{
+    return (c >= '0' && c <= '9') || c == '-';
+}
+
+
+
+/*
+ *  Alle Zahlen einlesen, die im Bereich [begin, end) der Datei beginnen;
+ *  die letzte darf über end hinausreichen (bis limit).
+ */
+void parseText (const char* begin, const char* end, const char* limit, vector<int64_t>& keys)
+{
+    const char*             p = begin;
+
+    while (p < end) {
+        if (! isNumberChar(*p)) {
+            p++;
+            continue;
+        }
+        bool negative = (*p == '-');
+        if (negative) {
+            p++;
+        }
+        int64_t value = 0;
+        bool digits = false;
+        while (p < limit && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+            digits = true;
+        }
+        if (digits) {
+            keys.push_back(negative ? -value : value);
+        }
+    }
+}
+
+
+
+/*
+ *  Datei in Stücke teilen; im Textformat werden die Grenzen so verschoben,
+ *  dass keine Zahl geteilt wird, im Binärformat auf ganze Werte gerundet.
+ *  Reste am Ende einer Binärdatei, die keinen ganzen Wert ergeben, sind ein Fehler.
+ */
+vector<pair<size_t, size_t>> makeChunks (const MappedFile& file, bool binary, size_t n)
+{
+    vector<pair<size_t, size_t>>    chunks;
+    size_t                          step = max<size_t>(file.size / n, 1 << 16);
+    size_t                          begin = 0;
+
+    if (binary && file.size % sizeof(int64_t) != 0) {
+        throw "Binary file ends with a partial key!";
+    }
+    while (begin < file.size) {
+        size_t end = min(begin + step, file.size);
+        if (binary) {
+            end -= end % sizeof(int64_t);
+            if (end <= begin) {
+                break;
+            }
+        }
+        else {
+            while (end < file.size && isNumberChar(file.data[end])) {
+                end++;
+            }
+        }
+        chunks.push_back(make_pair(begin, end));
+        begin = end;
+    }
+    return chunks;
+}
+
+
+
+/*
+ *  Ein Stück einlesen und sortieren
+ */
+vector<int64_t> readChunk (const MappedFile& file, bool binary, pair<size_t, size_t> chunk)
+{
+    vector<int64_t>         keys;
+
+    if (binary) {
+        keys.resize((chunk.second - chunk.first) / sizeof(int64_t));
+        memcpy(keys.data(), file.data + chunk.first, keys.size() * sizeof(int64_t));
+    }
+    else {
+        parseText(file.data + chunk.first, file.data + chunk.second, file.data + file.size, keys);
+    }
+    sort(keys.begin(), keys.end());
+    return keys;
+}
+
+
+
+/*
+ *  Eine Zeile der Statistik
+ */
+void report (const char* stage, size_t n, Clock::duration d)
+{
+    double                  s = chrono::duration<double>(d).count();
+
+    cout << left << setw(10) << stage << right
+         << setw(14) << n << " keys"
+         << setw(12) << fixed << setprecision(3) << s << " s"
+         << setw(14) << setprecision(0) << (s > 0 ? n / s : 0.0) << " keys/s" << endl;
+}
+
+
+
+/*
+ *  Schlüssel laden: Lesen und Sortieren der Stücke im Pool,
+ *  Einfügen im aufrufenden Thread, sobald ein Stück bereitsteht.
+ */
+template <typename Tree>
+void ingest (Tree& tree, const MappedFile& file, bool binary, AVL_ThreadPool& pool)
+{
+    vector<pair<size_t, size_t>>    chunks = makeChunks(file, binary, 4 * pool.size());
+    vector<function<void()>>        tasks;
+    ChunkQueue                      queue(chunks.size(), 2 * pool.size());
+    vector<int64_t>                 keys;
+    size_t                          parsed = 0;
+    size_t                          inserted = 0;
+    Clock::duration                 inserting = Clock::duration::zero();
+    Clock::time_point               start = Clock::now();
+    Clock::time_point               readDone;
+    exception_ptr                   error;
+
+    for (auto chunk : chunks) {
+        tasks.push_back([&file, binary, chunk, &queue] {
+            try {
+                queue.push(readChunk(file, binary, chunk));
+            } catch (...) {
+                queue.fail();
+                throw;
+            }
+        });
+    }
+    thread reader([&] {
+        try {
+            pool.run(tasks);
+        } catch (...) {
+            error = current_exception();
+        }
+        readDone = Clock::now();
+    });
+
+    try {
+        while (queue.pop(keys)) {
+            Clock::time_point t = Clock::now();
+            typename Tree::Finger finger;   // das Stück ist sortiert, also von Schlüssel zu Schlüssel weitersuchen
+            parsed += keys.size();
+            for (auto k : keys) {
+                if (tree.find_near(finger, k) == nullptr) {
+                    tree.insert(finger, k);
+                    inserted++;
+                }
+            }
+            inserting += Clock::now() - t;
+        }
+    } catch (...) {
+        queue.abort();   // sonst blieben die Leser in push hängen
+        reader.join();
+        throw;
+    }
+    reader.join();
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    report("read+sort", parsed, readDone - start);
+    report("insert", inserted, inserting);
+    report("total", inserted, Clock::now() - start);
+    cout << "duplicates: " << parsed - inserted << ", height: " << tree.getHeight() << endl;
+}
+
+
+
+/*
+ *  Anfragen einlesen und parallel im (jetzt unveränderten) Baum suchen
+ */
+template <typename Tree>
+void query (Tree& tree, const MappedFile& file, bool binary, AVL_ThreadPool& pool)
+{
+    vector<pair<size_t, size_t>>    chunks = makeChunks(file, binary, 4 * pool.size());
+    vector<vector<int64_t>>         keys(chunks.size());
+    vector<function<void()>>        tasks;
+    atomic<size_t>                  hits(0);
+    atomic<uint64_t>                checksum(0);   // Summe der gefundenen Schlüssel
+    size_t                          n = 0;
+    Clock::time_point               start = Clock::now();
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        tasks.push_back([&file, binary, &chunks, &keys, i] { keys[i] = readChunk(file, binary, chunks[i]); });
+    }
+    pool.run(tasks);
+    for (auto& k : keys) {
+        n += k.size();
+    }
+    Clock::time_point parsed = Clock::now();
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        tasks.push_back([&tree, &keys, &hits, &checksum, i] {
+            size_t found = 0;
+            uint64_t sum = 0;
+            for (auto k : keys[i]) {
+                auto p = tree.find(k);
+                if (p != nullptr) {
+                    found++;
+                    sum += uint64_t(p->getKey());   // der Schlüssel aus dem Knoten, nicht der gesuchte
+                }
+            }
+            hits += found;
+            checksum += sum;
+        });
+    }
+    pool.run(tasks);
+
+    report("read+sort", n, parsed - start);
+    report("find", n, Clock::now() - parsed);
+    cout << "hits: " << hits << ", misses: " << n - hits << ", checksum of hits: " << checksum << endl;
+}
+
+
+
+
+
+/*
+ *  Laden und gegebenenfalls Abfragen für die gewählte Baum-Variante
+ */
+template <typename Tree>
+void run (Tree& tree, int argc, char* argv[], bool binary, AVL_ThreadPool& pool)
+{
+    cout << ">>> Ingesting " << argv[optind] << endl;
+    {
+        MappedFile file(argv[optind]);
+        ingest(tree, file, binary, pool);
+    }
+    if (optind + 1 < argc) {
+        cout << ">>> Querying " << argv[optind + 1] << endl;
+        MappedFile file(argv[optind + 1]);
+        query(tree, file, binary, pool);
+    }
+    tree.check(pool);
+}
+
+
+
+
+
+int main (int argc, char* argv[])
+{
+    bool                    binary = false;
+    bool                    weak = false;
+    unsigned                threads = thread::hardware_concurrency();
+    int                     opt;
+    long                    value;
+    char*                   end;
+
+    while ((opt = getopt(argc, argv, "bwt:")) != -1) {
+        switch (opt) {
+        case 'b':
+            binary = true;
+            break;
+        case 'w':
+            weak = true;
+            break;
+        case 't':
+            errno = 0;
+            value = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || errno != 0 || value < 1 || value > 1024) {
+                cerr << argv[0] << ": -t needs a number of threads from 1 to 1024, not \"" << optarg << "\"" << endl;
+                return 2;
+            }
+            threads = unsigned(value);
+            break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-b] [-w] [-t threads] keys [queries]" << endl;
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        cerr << "Usage: " << argv[0] << " [-b] [-w] [-t threads] keys [queries]" << endl;
+        return 2;
+    }
+
+    try {
+        AVL_ThreadPool      pool(threads);
+
+        if (weak) {
+            AVL_Tree<int64_t, NoVal, NoAgg, WAVL_Balancing> tree;
+            run(tree, argc, argv, binary, pool);
+        }
+        else {
+            AVL_Tree<int64_t, NoVal> tree;
+            run(tree, argc, argv, binary, pool);
+        }
+    } catch (const char* s) {
+        cerr << "Something strange is gonna happen: " << s << endl;
+        return 1;
+    } catch (const exception& e) {
+        cerr << "Something strange is gonna happen: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = FastAVL-ingest
+CONFIG += console c++11 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+        ingest.cpp
+
+HEADERS += \
+    FastAVL.hpp
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <bitset>
+#include <set>
+#include <random>
 #include "FastAVL.hpp"
 
 using namespace std;
@@ -262,13 +264,39 @@ public:
 
 
 
+/*
+ *  Summe von sizeA über einen Unterbaum, für reduce
+ */
+class SumA
+{
+public:
+    typedef unsigned long   Type;
+
+    static Type identity ()
+    {
+        return 0;
+    }
+
+    static Type lift (KeyType&, ValType& v)
+    {
+        return v.sizeA;
+    }
+
+    static Type combine (Type a, Type b)
+    {
+        return a + b;
+    }
+};
+
+
+
 
 
 void testB()
 {
     try {
-        AVL_Tree<KeyType, ValType>*  tree = new AVL_Tree<KeyType, ValType>;
-        AVL_Node<KeyType, ValType>*  node;
+        AVL_Tree<KeyType, ValType, SumA>*  tree = new AVL_Tree<KeyType, ValType, SumA>;
+        AVL_Node<KeyType, ValType, SumA>*  node;
 
         cout << endl;
         cout << endl;
@@ -337,8 +365,982 @@ void testB()
                 node = tree->safeInsert(key);
                 node->sizeB++;
             }
+            tree->refresh(key);
             tree->display();
         }
+
+        cout << "Sum of sizeA for start 2: "
+             << tree->reduce(KeyType(bitset<64>(), 2, 0), KeyType(~bitset<64>(), 2, 255)) << endl;
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Zur Übersetzungszeit gebaute Tabelle (siehe AVL_StaticTree)
+ */
+constexpr int               staticKeys[] =
+{
+    100, 55, 50, 45, 47, 70, 80, 78, 77, 79,
+    82, 81, 83, 150, 140, 135, 142, 143, 180, 170,
+    165, 160, 175, 173, 200, 190, 195, 500, 1000, 1500,
+    82, 81, 83, 150, 140, 135
+};
+constexpr auto              staticTree = makeStaticTree(staticKeys);
+
+static_assert(staticTree.find(142) != nullptr && staticTree.find(141) == nullptr, "Static tree broken!");
+
+
+
+void testC ()
+{
+    int                     c[] = {45, 47, 50, 55, 70, 1111, 5000};
+
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Static        <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    cout << "Keys (" << staticTree.size() << ", height " << staticTree.getHeight() << "):";
+    staticTree.for_each([] (const int& k) { cout << " " << k; });
+    cout << endl;
+    for (auto x : c) {
+        cout << x << (staticTree.find(x) != nullptr ? " found" : " not found") << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  WAVL mit Zähler für die Rotationen: eine Rotation hat stattgefunden,
+ *  wenn p danach auf einen anderen Knoten zeigt, eine Doppelrotation,
+ *  wenn das nicht eines der bisherigen Kinder ist.
+ */
+class CountingWAVL : public WAVL_Balancing
+{
+public:
+    static unsigned         rotations;
+
+    template <typename Node>
+    static bool rebalance (Node*& p, int offset, bool insertNotRemove)
+    {
+        Node*               before = p;
+        Node*               smaller = p->smaller;
+        Node*               greater = p->greater;
+        bool                result = WAVL_Balancing::rebalance(p, offset, insertNotRemove);
+
+        if (p != before) {
+            rotations += (p == smaller || p == greater) ? 1 : 2;
+        }
+        return result;
+    }
+};
+
+unsigned CountingWAVL::rotations = 0;
+
+
+
+/*
+ *  WAVL: zufällig einfügen, löschen und Bereiche löschen, nach jedem Schritt check()
+ *  und Vergleich mit std::set; beim Löschen darf höchstens zweimal rotiert werden.
+ */
+void testD ()
+{
+    AVL_Tree<int, NoVal, NoAgg, CountingWAVL>   tree;
+    set<int>                                    model;
+    mt19937                                     random(31);
+    const int                                   steps = 5000;
+    unsigned                                    most = 0;
+    size_t                                      removed = 0;
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – WAVL          <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        for (int i = 0; i < steps; i++) {
+            int k = int(random() % 1000);
+            unsigned r = random() % 100;
+
+            if (r < 62) {
+                tree.safeInsert(k);
+                model.insert(k);
+            }
+            else if (r < 97) {
+                auto it = model.lower_bound(k);   // meist einen vorhandenen Schlüssel treffen
+                if (it != model.end()) {
+                    k = *it;
+                }
+                CountingWAVL::rotations = 0;
+                tree.safeRemove(k);
+                removed += model.erase(k);
+                most = max(most, CountingWAVL::rotations);
+                if (CountingWAVL::rotations > 2) {
+                    throw "More than two rotations for one delete!";
+                }
+            }
+            else {
+                int hi = k + int(random() % 50);
+                tree.erase_range(k, hi);
+                model.erase(model.lower_bound(k), model.upper_bound(hi));
+            }
+            tree.check();
+            if (tree.size() != model.size()) {
+                throw "Size differs from std::set!";
+            }
+        }
+        for (auto k : model) {
+            if (tree.find(k) == nullptr) {
+                throw "Key missing!";
+            }
+        }
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+        return;
+    }
+    cout << steps << " steps, " << removed << " deletes, at most " << most
+         << " rotations per delete, " << tree.size() << " keys, height " << tree.getHeight() << endl;
+}
+
+
+
+
+
+/*
+ *  Thread-Pool: viele run kurz hintereinander,
+ *  jede Aufgabe muss genau einmal gelaufen sein
+ */
+void testE ()
+{
+    AVL_ThreadPool          pool(4);
+    atomic<size_t>          done(0);
+    const size_t            runs = 200000;
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Thread pool   <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    for (size_t r = 0; r < runs; r++) {
+        vector<function<void()>> tasks;
+        for (unsigned i = 0; i < pool.size(); i++) {
+            tasks.push_back([&done] { done++; });
+        }
+        pool.run(tasks);
+        if (done != (r + 1) * pool.size()) {
+            cout << "Something strange is gonna happen: lost tasks in run " << r << endl;
+            return;
+        }
+    }
+    cout << runs << " runs with " << pool.size() << " tasks each ok" << endl;
+}
+
+
+
+
+
+/*
+ *  Combiner: mehrere Threads schreiben gleichzeitig, jeder auf eigenen Schlüsseln
+ *  (k mod threads), und vergleicht jedes Ergebnis mit seinem std::set
+ */
+void testCombiner (const char* name, double lazy)
+{
+    const int               threads = 8;
+    const int               ops = 20000;
+    AVL_Tree<int, NoVal>    tree;
+    AVL_Combiner<int>       combiner(tree, 16);
+    vector<set<int>>        models(threads);
+    atomic<size_t>          wrong(0);
+    vector<thread>          workers;
+    size_t                  n = 0;
+
+    tree.setLazyRemove(lazy);
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&, t] {
+            mt19937 random(t);
+            for (int i = 0; i < ops; i++) {
+                int k = int(random() % 1000) * threads + t;
+                bool had = models[t].count(k) > 0;
+                switch (random() % 3) {
+                case 0:
+                    wrong += (combiner.insert(k) == had);
+                    models[t].insert(k);
+                    break;
+                case 1:
+                    wrong += (combiner.remove(k) != had);
+                    models[t].erase(k);
+                    break;
+                default:
+                    wrong += (combiner.find(k) != had);
+                }
+            }
+        }));
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (auto& m : models) {
+        n += m.size();
+    }
+    try {
+        tree.check();
+        for (int t = 0; t < threads; t++) {
+            for (auto k : models[t]) {
+                if (tree.find(k) == nullptr) {
+                    wrong++;
+                }
+            }
+        }
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+        return;
+    }
+    cout << name << ": " << threads << " threads, " << threads * ops << " operations, "
+         << wrong << " wrong results, " << tree.size() << " keys (expected " << n << ")" << endl;
+}
+
+void testF ()
+{
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Combiner      <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    testCombiner("lazy remove", 0.3);
+    testCombiner("eager remove", 0);
+}
+
+
+
+
+
+/*
+ *  Eltern-Verweise: zufällig einfügen und über erase(Node*) löschen,
+ *  dabei next und prev gegen std::set prüfen, nach jedem Schritt check();
+ *  zum Schluss vorwärts und rückwärts durch den ganzen Baum laufen.
+ */
+template <typename Balancing>
+void testParentLinks (const char* name, double lazy)
+{
+    AVL_Tree<int, NoVal, NoAgg, Balancing, ParentLinks>   tree;
+    AVL_Node<int, NoVal, NoAgg, Balancing, ParentLinks>*  p;
+    set<int>                                              model;
+    mt19937                                               random(37);
+    size_t                                                erased = 0;
+
+    tree.setLazyRemove(lazy);
+    for (int i = 0; i < 4000; i++) {
+        int k = int(random() % 1000);
+
+        if (random() % 100 < 55) {
+            tree.safeInsert(k);
+            model.insert(k);
+        }
+        else if ((p = tree.find(k)) != nullptr) {
+            auto it = model.find(k);
+            auto after = next(it);
+            if ((tree.next(p) == nullptr) != (after == model.end())
+                    || (after != model.end() && tree.next(p)->getKey() != *after)) {
+                throw "next not in line!";
+            }
+            if ((tree.prev(p) == nullptr) != (it == model.begin())
+                    || (it != model.begin() && tree.prev(p)->getKey() != *prev(it))) {
+                throw "prev not in line!";
+            }
+            tree.erase(p);
+            model.erase(it);
+            erased++;
+        }
+        tree.check();
+        if (tree.size() != model.size()) {
+            throw "Size differs from std::set!";
+        }
+    }
+
+    p = model.empty() ? nullptr : tree.find(*model.begin());
+    for (auto k : model) {
+        if (p == nullptr || p->getKey() != k) {
+            throw "Walk with next not in line!";
+        }
+        p = tree.next(p);
+    }
+    p = model.empty() ? nullptr : tree.find(*model.rbegin());
+    for (auto it = model.rbegin(); it != model.rend(); ++it) {
+        if (p == nullptr || p->getKey() != *it) {
+            throw "Walk with prev not in line!";
+        }
+        p = tree.prev(p);
+    }
+    cout << name << ": " << erased << " erased through nodes, " << tree.size()
+         << " keys walked both ways, height " << tree.getHeight() << endl;
+}
+
+void testG ()
+{
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Parent links  <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        testParentLinks<AVL_Balancing>("AVL", 0);
+        testParentLinks<WAVL_Balancing>("WAVL", 0);
+        testParentLinks<AVL_Balancing>("AVL, lazy remove", 0.3);
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Node-Handles: umschlüsseln, in einen anderen Baum umziehen,
+ *  doppelter Schlüssel (wirft, das Handle behält den Knoten)
+ *  und Einhängen an Stelle eines Grabsteins
+ */
+void testH ()
+{
+    using Tree = AVL_Tree<int, ValType>;
+
+    Tree                    a;
+    Tree                    b;
+    Tree                    c;
+    Tree::Handle            h;
+    AVL_Node<int, ValType>* n;
+    bool                    caught = false;
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Node handles  <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        c.setLazyRemove(0.9);
+        for (int i = 0; i < 100; i++) {
+            a.insert(i)->sizeA = 10 * i;
+            c.insert(i);
+        }
+
+        h = a.extract(42);
+        n = h.get();
+        h.setKey(1042);
+        if (a.insert(move(h)) != n || ! h.empty() || a.find(42) != nullptr
+                || a.find(1042) != n || n->sizeA != 420) {
+            throw "Re-keying through a handle failed!";
+        }
+        a.check();
+        cout << "Re-keyed 42 to 1042, same node, value " << n->sizeA << endl;
+
+        h = a.extract(7);
+        n = h.get();
+        if (b.insert(move(h)) != n || a.find(7) != nullptr || b.find(7) != n
+                || n->sizeA != 70 || a.size() != 99 || b.size() != 1) {
+            throw "Moving a node to another tree failed!";
+        }
+        a.check();
+        b.check();
+        cout << "Moved 7 to a second tree, sizes " << a.size() << " and " << b.size() << endl;
+
+        h = a.extract(8);
+        n = h.get();
+        h.setKey(9);
+        try {
+            a.insert(move(h));
+        } catch (const char * s) {
+            caught = true;
+            cout << ">>> Caught: (9) " << s << endl;
+        }
+        if (! caught || h.get() != n || a.size() != 98) {
+            throw "Duplicate key didn’t leave the node in the handle!";
+        }
+        a.check();
+        h.setKey(8);
+        a.insert(move(h));
+        cout << "Duplicate rejected, node kept and reinserted, size " << a.size() << endl;
+
+        c.remove(50);
+        h = a.extract(60);
+        n = h.get();
+        h.setKey(50);
+        if (c.insert(move(h)) != n || c.find(50) != n || c.size() != 100) {
+            throw "Replacing a tombstone failed!";
+        }
+        c.check();
+        c.purge();
+        if (c.find(50) != n || n->sizeA != 600) {
+            throw "Replaced tombstone lost after purge!";
+        }
+        c.check();
+        cout << "Tombstone 50 replaced by the node of 60, value " << n->sizeA << endl;
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Schlüssel, deren Ordnung sich nachträglich verdrehen lässt:
+ *  ist twisted gesetzt, tauschen die Werte twistA und twistB die Plätze.
+ *  So lässt sich eine Verletzung der Schlüsselreihenfolge herstellen,
+ *  ohne an die Knoten heranzukommen.
+ */
+class TwistKey
+{
+public:
+    static bool             twisted;
+    static const int        twistA = 100;
+    static const int        twistB = 900;
+
+    int                     v;
+
+    TwistKey (int x = 0)
+    {
+        v = x;
+    }
+
+    int rank () const
+    {
+        return ! twisted ? v : v == twistA ? twistB : v == twistB ? twistA : v;
+    }
+
+    bool operator< (const TwistKey& k) const
+    {
+        return rank() < k.rank();
+    }
+
+    bool operator> (const TwistKey& k) const
+    {
+        return rank() > k.rank();
+    }
+
+    bool operator== (const TwistKey& k) const
+    {
+        return v == k.v;
+    }
+
+    bool operator!= (const TwistKey& k) const
+    {
+        return v != k.v;
+    }
+
+    friend std::ostream& operator<< (std::ostream& out, const TwistKey& k)
+    {
+        return out << k.v;
+    }
+};
+
+bool TwistKey::twisted = false;
+
+
+
+/*
+ *  checkStep: Runden in kleinen Portionen, dazwischen jeweils mehr Änderungen,
+ *  als sich der Baum merken kann (maxTouched); zum Schluss eine verdrehte
+ *  Schlüsselreihenfolge, die check() nicht sieht, checkStep aber findet.
+ */
+void testI ()
+{
+    AVL_Tree<int, NoVal>        tree;
+    AVL_Tree<TwistKey, NoVal>   twist;
+    mt19937                     random(30);
+    unsigned                    steps = 0;
+    unsigned                    rounds = 0;
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – checkStep     <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        for (int i = 0; i < 2000; i++) {
+            tree.safeInsert(int(random() % 10000));
+        }
+        while (rounds < 3) {
+            for (int i = 0; i < 100; i++) {   // mehr als maxTouched Änderungen
+                int k = int(random() % 10000);
+                if (random() % 2) {
+                    tree.safeInsert(k);
+                }
+                else {
+                    tree.safeRemove(k);
+                }
+            }
+            rounds += tree.checkStep(16);
+            steps++;
+        }
+        tree.check();
+        cout << rounds << " rounds in " << steps << " steps of 16, "
+             << steps * 100 << " changes in between, " << tree.size() << " keys" << endl;
+
+        for (int i = 0; i < 1000; i++) {
+            twist.insert(TwistKey(i));
+        }
+        while (! twist.checkStep(16)) {
+        }
+        TwistKey::twisted = true;
+        twist.check();
+        cout << "Keys " << TwistKey::twistA << " and " << TwistKey::twistB
+             << " swapped, check(): Good" << endl;
+        try {
+            while (! twist.checkStep(16)) {
+            }
+            cout << "Something strange is gonna happen: checkStep missed the swapped keys" << endl;
+        } catch (const char * s) {
+            cout << ">>> Caught: checkStep: " << s << endl;
+        }
+        TwistKey::twisted = false;
+    } catch (const char * s) {
+        TwistKey::twisted = false;
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Macht splitDepth sichtbar, damit der Test nachweisen kann,
+ *  dass der Baum wirklich zerlegt wird
+ */
+class SplitTree : public AVL_Tree<int, NoVal>
+{
+public:
+    using AVL_Tree<int, NoVal>::splitDepth;
+};
+
+
+
+/*
+ *  parallel_for_each und parallel_reduce auf einem Baum, der hoch genug
+ *  zum Aufteilen ist (mit Grabsteinen), gegen das serielle for_each.
+ *  reduce bildet einen Polynom-Hash – der ist assoziativ, aber nicht kommutativ,
+ *  und stimmt daher nur bei aufsteigender Reihenfolge mit dem seriellen überein.
+ */
+void testJ ()
+{
+    typedef pair<uint64_t, uint64_t>    Hash;       // Hash, Basis hoch Anzahl
+    const uint64_t          base = 1000003;
+    const int               count = 1 << 19;
+    SplitTree               tree;
+    AVL_ThreadPool          pool(4);
+    mt19937                 random(4711);
+    uint64_t                serialSum = 0;
+    size_t                  serialCount = 0;
+    Hash                    serialHash(0, 1);
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Parallel      <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    auto map = [base] (AVL_Node<int, NoVal>* p) { return Hash(p->getKey(), base); };
+    auto combine = [] (Hash a, Hash b) { return Hash(a.first * b.second + b.first, a.second * b.second); };
+
+    try {
+        tree.setLazyRemove(0.3);
+        for (int i = 0; i < count; i++) {
+            tree.safeInsert(random() % (4 * count));
+        }
+        for (int i = 0; i < count / 8; i++) {
+            tree.safeRemove(random() % (4 * count));
+        }
+        if (tree.splitDepth(pool.size()) == 0 || tree.splitDepth(AVL_ThreadPool::sharedSize()) == 0) {
+            throw "Tree too low to split!";
+        }
+
+        tree.for_each([&] (AVL_Node<int, NoVal>* p) {
+            serialSum += p->getKey();
+            serialCount++;
+            serialHash = combine(serialHash, map(p));
+        });
+
+        for (int shared = 0; shared < 2; shared++) {
+            atomic<uint64_t>    sum(0);
+            atomic<size_t>      seen(0);
+            Hash                hash;
+            auto                f = [&sum, &seen] (AVL_Node<int, NoVal>* p) { sum += p->getKey(); seen++; };
+
+            if (shared) {
+                tree.parallel_for_each(f);
+                hash = tree.parallel_reduce(Hash(0, 1), map, combine);
+                tree.check();
+            }
+            else {
+                tree.parallel_for_each(f, pool);
+                hash = tree.parallel_reduce(Hash(0, 1), map, combine, pool);
+                tree.check(pool);
+            }
+            if (sum != serialSum || seen != serialCount) {
+                throw "parallel_for_each differs from for_each!";
+            }
+            if (hash != serialHash) {
+                throw "parallel_reduce differs from serial order!";
+            }
+            cout << (shared ? "shared pool: " : "own pool:    ") << seen << " keys, height " << tree.getHeight()
+                 << ", split at depth " << tree.splitDepth(shared ? AVL_ThreadPool::sharedSize() : pool.size())
+                 << ": Good" << endl;
+        }
+        if (tree.size() != serialCount) {
+            throw "Size differs from for_each!";
+        }
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Löschen über den Finger: fast sortiert einfügen und löschen (ein Zufallsweg),
+ *  beides über denselben Finger, gegen std::set; nach jedem Schritt check()
+ */
+template <typename Balancing, typename Links>
+void testFingerRemove (const char* name)
+{
+    AVL_Tree<int, NoVal, NoAgg, Balancing, Links>           tree;
+    typename AVL_Tree<int, NoVal, NoAgg, Balancing, Links>::Finger  finger;
+    set<int>                model;
+    mt19937                 random(99);
+    int                     k = 0;
+    size_t                  removed = 0;
+
+    for (int i = 0; i < 20000; i++) {
+        k += int(random() % 21) - 10;
+        if (model.count(k) == 0) {
+            tree.insert(finger, k);
+            model.insert(k);
+        }
+        else {
+            tree.remove(finger, k);
+            model.erase(k);
+            removed++;
+        }
+        if ((tree.find_near(finger, k) != nullptr) != (model.count(k) > 0)) {
+            throw "find_near after finger step not in line!";
+        }
+        tree.check();
+        if (tree.size() != model.size()) {
+            throw "Size differs from std::set!";
+        }
+    }
+    for (auto key : model) {
+        if (tree.find(key) == nullptr) {
+            throw "Key lost by finger remove!";
+        }
+    }
+    cout << name << ": " << removed << " removed through the finger, "
+         << tree.size() << " keys left, height " << tree.getHeight() << endl;
+}
+
+void testK ()
+{
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Finger remove <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        testFingerRemove<AVL_Balancing, NoParent>("AVL");
+        testFingerRemove<WAVL_Balancing, NoParent>("WAVL");
+        testFingerRemove<AVL_Balancing, ParentLinks>("AVL, parent links");
+        testFingerRemove<WAVL_Balancing, ParentLinks>("WAVL, parent links");
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Aufzeichnen und Nachspielen: ein kurzer Lauf mit allen aufgezeichneten Operationen,
+ *  auch mit solchen, die werfen (die dürfen in der Spur nicht stehen);
+ *  die Spur wird auf einen leeren Baum nachgespielt, der danach gleich sein muss
+ */
+void testL ()
+{
+    using Tree = AVL_Tree<int, NoVal, NoAgg, AVL_Balancing, ParentLinks>;
+
+    const char*             fileName = "FastAVL-demo.trace";
+    Tree                    tree;
+    Tree                    replayed;
+    Tree::Finger            finger;
+    Tree::Handle            h;
+    mt19937                 random(7);
+    vector<int>             keys;
+    vector<int>             replayedKeys;
+    size_t                  rejected = 0;
+    size_t                  records = 0;
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Record/replay <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        {
+            AVL_Recorder<int> recorder(fileName);
+
+            tree.setRecorder(&recorder);
+            for (int i = 0; i < 3000; i++) {
+                int k = random() % 200;
+                try {
+                    switch (random() % 9) {
+                    case 0: tree.insert(k); break;
+                    case 1: tree.remove(k); break;
+                    case 2: tree.safeInsert(k); break;
+                    case 3: tree.safeRemove(k); break;
+                    case 4: tree.find(k); break;
+                    case 5: tree.insert(finger, k); break;
+                    case 6: tree.remove(finger, k); break;
+                    case 7:
+                        if (tree.find(k) != nullptr) {
+                            tree.erase(tree.find(k));
+                        }
+                        break;
+                    default:
+                        h = tree.extract(k);
+                        h.setKey(k + 1);
+                        try {
+                            tree.insert(move(h));
+                        } catch (const char *) {
+                            h.setKey(k);   // Schlüssel k + 1 war schon da: zurück an den alten Platz
+                            tree.insert(move(h));
+                            throw;
+                        }
+                    }
+                } catch (const char *) {
+                    rejected++;
+                }
+            }
+            tree.setRecorder(nullptr);
+        }
+
+        ifstream            in(fileName, ios::binary);
+        AVL_TraceHeader     header;
+        char                op;
+        int                 k;
+
+        if (! in.read(reinterpret_cast<char*>(&header), sizeof(header))
+                || memcmp(header.magic, "AVLT", 4) != 0 || header.keySize != sizeof(int)) {
+            throw "Trace header not in line!";
+        }
+        while (in.read(&op, 1) && in.read(reinterpret_cast<char*>(&k), sizeof(k))) {
+            switch (op) {   // eine Operation, die beim Nachspielen wirft, hätte nicht in der Spur stehen dürfen
+            case AVL_Recorder<int>::Insert:     replayed.insert(k); break;
+            case AVL_Recorder<int>::Remove:     replayed.remove(k); break;
+            case AVL_Recorder<int>::Find:       replayed.find(k); break;
+            case AVL_Recorder<int>::SafeInsert: replayed.safeInsert(k); break;
+            case AVL_Recorder<int>::SafeRemove: replayed.safeRemove(k); break;
+            default: throw "Unknown operation in trace!";
+            }
+            records++;
+        }
+        in.close();
+        remove(fileName);
+
+        tree.for_each([&keys] (AVL_Node<int, NoVal, NoAgg, AVL_Balancing, ParentLinks>* p) { keys.push_back(p->getKey()); });
+        replayed.for_each([&replayedKeys] (AVL_Node<int, NoVal, NoAgg, AVL_Balancing, ParentLinks>* p) { replayedKeys.push_back(p->getKey()); });
+        replayed.check();
+        if (keys != replayedKeys || tree.size() != replayed.size()) {
+            throw "Replayed tree differs from the recorded one!";
+        }
+        cout << records << " operations recorded, " << rejected << " rejected and not recorded, "
+             << replayed.size() << " keys after replay: Good" << endl;
+    } catch (const char * s) {
+        remove(fileName);
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  Block-Baum gegen std::set: zufällig einfügen und löschen, dann in zufälliger
+ *  Reihenfolge bis auf einen Block und weiter bis zum leeren Baum abbauen.
+ *  Nach jedem Schritt check() (auch der Füllstand, also Zusammenlegen
+ *  und Umverteilen) und find für den Schlüssel und seine Nachbarn,
+ *  die oft genau an einer Blockgrenze liegen.
+ *  step spreizt die Schlüssel, bei int64_t über 32 Bit hinaus.
+ */
+template <typename Key>
+void testBlockTree (const char* name, Key step)
+{
+    AVL_BlockTree<Key>      tree;
+    set<Key>                model;
+    vector<Key>             order;
+    mt19937                 random(11);
+    size_t                  drained = 0;       // Schlüssel, als nur noch ein Block übrig war
+    const Key               offset = -1000 * step;
+
+    auto same = [&tree, &model] (Key k) {
+        for (Key x : {k - 1, k, k + 1}) {
+            const Key* found = tree.find(x);
+            if ((found != nullptr) != (model.count(x) > 0) || (found != nullptr && *found != x)) {
+                throw "find differs from std::set!";
+            }
+        }
+    };
+
+    for (int i = 0; i < 20000; i++) {
+        Key k = Key(random() % 3000) * step + offset;
+        if (random() % 3 != 0) {
+            tree.safeInsert(k);
+            model.insert(k);
+        }
+        else {
+            tree.safeRemove(k);
+            model.erase(k);
+        }
+        tree.check();
+        same(k);
+    }
+    tree.for_each([&order] (const Key& k) { order.push_back(k); });
+    if (! equal(order.begin(), order.end(), model.begin(), model.end())) {
+        throw "for_each differs from std::set!";
+    }
+    for (Key k : order) {
+        same(k);
+    }
+
+    shuffle(order.begin(), order.end(), random);
+    for (Key k : order) {
+        tree.remove(k);
+        model.erase(k);
+        tree.check();
+        same(k);
+        if (drained == 0 && tree.getHeight() == 1) {
+            drained = model.size();
+        }
+    }
+    if (tree.getHeight() != 0 || drained == 0) {
+        throw "Tree not drained!";
+    }
+    cout << name << ": " << order.size() << " keys, capacity " << AVL_Block<Key, 128>::capacity
+         << ", one block left at " << drained << " keys, drained: Good" << endl;
+}
+
+void testM ()
+{
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Block tree    <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    try {
+        testBlockTree<int>("int", 7);
+#ifdef __SSE4_2__
+        testBlockTree<int64_t>("int64_t (SSE4.2)", int64_t(1) << 33);
+#else
+        testBlockTree<int64_t>("int64_t", int64_t(1) << 33);
+#endif
+    } catch (const char * s) {
+        cout << "Something strange is gonna happen: " << s << endl;
+    }
+}
+
+
+
+
+
+/*
+ *  erase_range im AVL-Modus mit Grabsteinen, freigegeben im Hintergrund:
+ *  zufällige Bereiche, dazu ein leerer Bereich (zwischen zwei Schlüsseln),
+ *  lo > hi und zum Schluss der ganze Baum; nach jedem Schritt check()
+ *  und Vergleich mit std::set (size() verrechnet dabei die Zählungen des Hintergrunds)
+ */
+void testN ()
+{
+    AVL_Tree<int, NoVal>    tree;
+    set<int>                model;
+    mt19937                 random(53);
+    size_t                  erased = 0;
+
+    cout << endl;
+    cout << "========================================" << endl;
+    cout << ">>>   FastAVL – Test – Erase range   <<<" << endl;
+    cout << "========================================" << endl;
+    cout << endl;
+
+    auto same = [&tree, &model] (const char* what) {
+        tree.check();
+        if (tree.size() != model.size()) {
+            throw what;
+        }
+    };
+
+    try {
+        tree.setLazyRemove(0.5);
+        for (int round = 0; round < 200; round++) {
+            for (int i = 0; i < 200; i++) {
+                int k = 2 * int(random() % 5000);   // nur gerade Schlüssel, die ungeraden bleiben frei
+                if (random() % 4 != 0) {
+                    tree.safeInsert(k);
+                    model.insert(k);
+                }
+                else {
+                    tree.safeRemove(k);   // hinterlässt Grabsteine, auch mitten in den Bereichen
+                    model.erase(k);
+                }
+            }
+
+            int lo = 2 * int(random() % 5000);
+            int hi = lo + 2 * int(random() % 200);
+            size_t before = model.size();
+            tree.erase_range(lo, hi, true);
+            model.erase(model.lower_bound(lo), model.upper_bound(hi));
+            erased += before - model.size();
+            same("Size differs after erase_range!");
+
+            tree.erase_range(lo + 1, lo + 1, true);   // ungerade: kein Schlüssel im Bereich
+            same("Size differs after an empty range!");
+
+            tree.erase_range(hi, lo - 2, true);       // lo > hi
+            same("Size differs after lo > hi!");
+        }
+        for (auto k : model) {
+            if (tree.find(k) == nullptr) {
+                throw "Key missing!";
+            }
+        }
+        cout << "200 rounds, " << erased << " keys erased in ranges, " << model.size() << " left" << endl;
+
+        tree.erase_range(*model.begin(), *model.rbegin(), true);
+        model.clear();
+        same("Size differs after erasing the whole tree!");
+        if (tree.getHeight() != 0 || tree.find(0) != nullptr) {
+            throw "Tree not empty after erasing the whole tree!";
+        }
+        AVL_Reclaimer::shared().wait();
+        cout << "Whole tree erased in the background, size " << tree.size() << ": Good" << endl;
     } catch (const char * s) {
         cout << "Something strange is gonna happen: " << s << endl;
     }
@@ -352,5 +1354,17 @@ int main()
 {
     testA ();
     testB ();
+    testC ();
+    testD ();
+    testE ();
+    testF ();
+    testG ();
+    testH ();
+    testI ();
+    testJ ();
+    testK ();
+    testL ();
+    testM ();
+    testN ();
     return 0;
 }
@@ -0,0 +1,269 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include "FastAVL.hpp"
+
+using namespace std;
+
+
+
+/*
+ *  ======================================================================
+ *  FastAVL-replay
+ *
+ *  Spielt eine mit AVL_Recorder aufgezeichnete Folge von Operationen
+ *  gegen eine wählbare Baum-Variante nach und gibt je Art der Operation
+ *  die Latenzen als Histogramm (Zweierpotenzen in ns) und Perzentile aus.
+ *
+ *      FastAVL-replay [-w] [-l ratio] [-k] trace
+ *
+ *  -w   WAVL_Balancing statt des klassischen AVL-Baums
+ *  -l   verzögertes Löschen (setLazyRemove) mit dem angegebenen Anteil
+ *  -k   AVL_BlockTree statt AVL_Tree (ohne -l, der Block-Baum löscht nicht verzögert)
+ *
+ *  Nachgespielt werden Spuren mit ganzzahligen Schlüsseln (4 oder 8 Bytes);
+ *  für andere Schlüsseltypen lässt sich replay<Tree, Key> direkt aufrufen.
+ *  Die Zeitmessung je Operation kostet selbst einige zehn ns.
+ *  ======================================================================
+ */
+
+
+
+using Clock = chrono::steady_clock;
+
+const char*                 opNames[] = {"insert", "remove", "find", "safeInsert", "safeRemove"};
+const unsigned              opCount = 5;
+
+
+
+/*
+ *  Die aufgezeichneten Operationen
+ */
+template <typename Key>
+class Trace
+{
+public:
+    vector<unsigned char>   ops;
+    vector<Key>             keys;
+
+    Trace (const vector<char>& data)
+    {
+        size_t              record = 1 + sizeof(Key);
+        size_t              n = (data.size() - sizeof(AVL_TraceHeader)) / record;
+        const char*         p = data.data() + sizeof(AVL_TraceHeader);
+
+        ops.resize(n);
+        keys.resize(n);
+        for (size_t i = 0; i < n; i++, p += record) {
+            ops[i] = *p;
+            memcpy(&keys[i], p + 1, sizeof(Key));
+            if (ops[i] >= opCount) {
+                throw "Unknown operation in trace!";
+            }
+        }
+    }
+};
+
+
+
+/*
+ *  Spur vollständig einlesen und den Kopf prüfen
+ */
+vector<char> readTrace (const char* name, AVL_TraceHeader& header)
+{
+    ifstream                in(name, ios::binary);
+    vector<char>            data;
+
+    if (! in) {
+        throw "Can’t open trace file!";
+    }
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    if (data.size() < sizeof(header)) {
+        throw "Trace file too short!";
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, "AVLT", 4) != 0 || header.version != 1) {
+        throw "No trace file!";
+    }
+    return data;
+}
+
+
+
+/*
+ *  Eine Zeile der Statistik und das Histogramm für eine Art der Operation
+ */
+void report (const char* name, vector<uint32_t>& ns)
+{
+    vector<size_t>          buckets(33, 0);
+    size_t                  most = 0;
+    double                  sum = 0;
+
+    if (ns.empty()) {
+        return;
+    }
+    for (auto t : ns) {
+        unsigned b = 0;
+        while (b < 32 && (t >> b) > 1) {
+            b++;
+        }
+        buckets[b]++;
+        most = max(most, buckets[b]);
+        sum += t;
+    }
+    sort(ns.begin(), ns.end());
+    auto pct = [&ns] (double p) { return ns[min(ns.size() - 1, size_t(p * ns.size()))]; };
+
+    cout << left << setw(12) << name << right
+         << setw(10) << ns.size() << " ops"
+         << "   mean " << fixed << setprecision(0) << sum / ns.size()
+         << "   p50 " << pct(0.5) << "   p90 " << pct(0.9)
+         << "   p99 " << pct(0.99) << "   p99.9 " << pct(0.999)
+         << "   max " << ns.back() << " ns" << endl;
+    for (unsigned b = 0; b <= 32; b++) {
+        if (buckets[b] > 0) {
+            cout << setw(14) << (1ul << b) << " ns" << setw(12) << buckets[b] << "  "
+                 << string((buckets[b] * 50 + most - 1) / most, '#') << endl;
+        }
+    }
+}
+
+
+
+/*
+ *  Spur gegen den Baum tree nachspielen; Fehler (etwa doppeltes insert)
+ *  werden nur gezählt, weil sie schon bei der Aufzeichnung aufgetreten sind.
+ */
+template <typename Tree, typename Key>
+void replay (Tree& tree, const Trace<Key>& trace)
+{
+    vector<vector<uint32_t>>    latencies(opCount);
+    size_t                      errors = 0;
+    Clock::time_point           start = Clock::now();
+
+    for (size_t i = 0; i < trace.ops.size(); i++) {
+        Key k = trace.keys[i];
+        Clock::time_point t = Clock::now();
+        try {
+            switch (trace.ops[i]) {
+            case AVL_Recorder<Key>::Insert:
+                tree.insert(k);
+                break;
+            case AVL_Recorder<Key>::Remove:
+                tree.remove(k);
+                break;
+            case AVL_Recorder<Key>::Find:
+                tree.find(k);
+                break;
+            case AVL_Recorder<Key>::SafeInsert:
+                tree.safeInsert(k);
+                break;
+            case AVL_Recorder<Key>::SafeRemove:
+                tree.safeRemove(k);
+                break;
+            }
+        } catch (const char*) {
+            errors++;
+        }
+        latencies[trace.ops[i]].push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - t).count());
+    }
+    double s = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << trace.ops.size() << " operations in " << fixed << setprecision(3) << s << " s, "
+         << errors << " errors, height " << tree.getHeight() << endl << endl;
+    for (unsigned op = 0; op < opCount; op++) {
+        report(opNames[op], latencies[op]);
+    }
+    tree.check();
+}
+
+
+
+/*
+ *  Baum-Variante nach den Optionen wählen
+ */
+template <typename Key>
+void run (const vector<char>& data, bool weak, double lazy, bool blocks)
+{
+    Trace<Key>              trace(data);
+
+    if (blocks && weak) {
+        AVL_BlockTree<Key, 128, WAVL_Balancing> tree;
+        replay(tree, trace);
+    }
+    else if (blocks) {
+        AVL_BlockTree<Key> tree;
+        replay(tree, trace);
+    }
+    else if (weak) {
+        AVL_Tree<Key, NoVal, NoAgg, WAVL_Balancing> tree;
+        tree.setLazyRemove(lazy);
+        replay(tree, trace);
+    }
+    else {
+        AVL_Tree<Key, NoVal> tree;
+        tree.setLazyRemove(lazy);
+        replay(tree, trace);
+    }
+}
+
+
+
+
+
+int main (int argc, char* argv[])
+{
+    bool                    weak = false;
+    bool                    blocks = false;
+    double                  lazy = 0;
+    int                     opt;
+    AVL_TraceHeader         header;
+
+    while ((opt = getopt(argc, argv, "wl:k")) != -1) {
+        switch (opt) {
+        case 'w':
+            weak = true;
+            break;
+        case 'l':
+            lazy = atof(optarg);
+            break;
+        case 'k':
+            blocks = true;
+            break;
+        default:
+            cerr << "Usage: " << argv[0] << " [-w] [-l ratio] [-k] trace" << endl;
+            return 2;
+        }
+    }
+    if (blocks && lazy > 0) {
+        cerr << argv[0] << ": -l can’t be combined with -k" << endl;
+        return 2;
+    }
+    if (optind >= argc) {
+        cerr << "Usage: " << argv[0] << " [-w] [-l ratio] [-k] trace" << endl;
+        return 2;
+    }
+
+    try {
+        vector<char> data = readTrace(argv[optind], header);
+
+        switch (header.keySize) {
+        case 4:
+            run<int32_t>(data, weak, lazy, blocks);
+            break;
+        case 8:
+            run<int64_t>(data, weak, lazy, blocks);
+            break;
+        default:
+            throw "Only 4 or 8 byte integer keys supported!";
+        }
+    } catch (const char* s) {
+        cerr << "Something strange is gonna happen: " << s << endl;
+        return 1;
+    }
+    return 0;
+}
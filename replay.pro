@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = FastAVL-replay
+CONFIG += console c++11 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+        replay.cpp
+
+HEADERS += \
+    FastAVL.hpp